@@ -33,8 +33,25 @@
 #include <libswresample/swresample.h>
 #include <libavutil/opt.h>
 
+#include <gio/gio.h>
 #include <glib.h>
 
+static AVFormatContext *audio_format_alloc(void);
+
+/* a cancelled scan interrupts the reads of its thread */
+static AVFormatContext *
+audio_format_alloc(void) {
+    AVFormatContext *fmt_ctx;
+
+    fmt_ctx = avformat_alloc_context();
+    if (fmt_ctx) {
+        fmt_ctx->interrupt_callback.callback = fd_interrupt;
+        fmt_ctx->interrupt_callback.opaque = g_cancellable_get_current();
+    }
+
+    return fmt_ctx;
+}
+
 audio_info *
 audio_get_info(const char *file) {
     audio_info *info;
@@ -42,6 +59,7 @@ audio_get_info(const char *file) {
     AVStream *stream = NULL;
     int s, ret;
 
+    fmt_ctx = audio_format_alloc();
     ret = avformat_open_input(&fmt_ctx, file, NULL, NULL);
     if (ret != 0) {
         g_warning (_("could not open: %s"), file);
@@ -118,7 +136,11 @@ audio_extract(const char *file,
     int s, ret, bytes = -1, want_samples, got_samples;
     int64_t seek_target;
     float total_length;
+    GCancellable *cancel;
 
+    *pBuffer = NULL;
+    cancel = g_cancellable_get_current();
+    format_ctx = audio_format_alloc();
     if (avformat_open_input(&format_ctx, file, NULL, NULL) != 0) {
         g_warning (_("could not open: %s"), file);
         goto end;
@@ -248,6 +270,11 @@ audio_extract(const char *file,
 
     got_samples = 0;
     while (av_read_frame(format_ctx, packet) == 0) {
+        if (g_cancellable_is_cancelled(cancel)) {
+            av_packet_unref(packet);
+            break;
+        }
+
         if (packet->stream_index != s) {
             av_packet_unref(packet);
             continue;
@@ -303,6 +330,11 @@ audio_extract(const char *file,
         }
     }
 
+    /* a cut short buffer must not be fingerprinted and cached */
+    if (g_cancellable_is_cancelled(cancel)) {
+        bytes = -1;
+    }
+
     end:
     if (convert_ctx) {
         swr_free(&convert_ctx);
@@ -325,6 +357,11 @@ audio_extract(const char *file,
         avformat_close_input(&format_ctx);
     }
 
+    if (bytes < 0 && *pBuffer) {
+        g_free(*pBuffer);
+        *pBuffer = NULL;
+    }
+
     return bytes;
 }
 
@@ -401,7 +438,7 @@ audio_hash_peak_append(const char *hash, int offset, void *ptr) {
 
     snprintf(peak.hash, sizeof peak.hash, "%s", hash);
     peak.offset = offset;
-    hash_array_append(array, &peak, sizeof(peak));
+    hash_array_append(array, &peak);
 
     return 0;
 }
@@ -417,8 +454,11 @@ audio_fingerprint(const char *file) {
     medialen = audio_get_length(file);
     g_return_val_if_fail(medialen > 0, NULL);
 
+    /* fails quietly too when the scan was cancelled */
     memlen = audio_extract(file, 0.f, medialen, 22050, &buf, &samples);
-    g_return_val_if_fail(memlen > 0, NULL);
+    if (memlen <= 0) {
+        return NULL;
+    }
 
     datas = g_new(float, samples);
     if (datas == NULL) {
@@ -432,11 +472,16 @@ audio_fingerprint(const char *file) {
     for (array = NULL, amp_min = 50; amp_min >= 5; amp_min -= 5) {
         if (array)
             hash_array_free(array);
-        array = hash_array_new();
+        array = hash_array_new(FDUPVES_AUDIO_HASH, sizeof(audio_peak_hash));
         if (array == NULL)
             break;
 
         fingerprint(datas, samples, 22050, amp_min, audio_hash_peak_append, array);
+        if (g_cancellable_is_cancelled(g_cancellable_get_current())) {
+            hash_array_free(array);
+            array = NULL;
+            break;
+        }
         if (hash_array_size(array) > (((int) medialen) >> 2))
             break;
     }
@@ -449,19 +494,23 @@ audio_fingerprint(const char *file) {
 
 int
 audio_fingerprint_similarity(hash_array_t *array1, hash_array_t *array2) {
-    int dis, i, j;
+    int dis;
+    gsize i, j, n1, n2;
     audio_peak_hash *ph1, *ph2;
 
     if (array1 == NULL || array2 == NULL) {
         return 0;
     }
 
+    ph1 = hash_array_data(array1);
+    ph2 = hash_array_data(array2);
+    n1 = hash_array_size(array1);
+    n2 = hash_array_size(array2);
+
     dis = 0;
-    for (i = 0; i < hash_array_size(array1); ++i) {
-        ph1 = hash_array_index(array1, i);
-        for (j = 0; j < hash_array_size(array2); ++j) {
-            ph2 = hash_array_index(array2, j);
-            if (strcmp(ph1->hash, ph2->hash) == 0) {
+    for (i = 0; i < n1; ++i) {
+        for (j = 0; j < n2; ++j) {
+            if (strcmp(ph1[i].hash, ph2[j].hash) == 0) {
                 dis++;
                 break;
             }
@@ -0,0 +1,427 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE audio_index.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "audio_index.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct audio_peak
+{
+  /* the zero padded hash string, equal keys mean equal strings */
+  guint64 key[2];
+  gint offset;
+};
+
+struct audio_posting
+{
+  guint file;
+  gint offset;
+};
+
+/* postings of one hash, sorted by (file, offset) */
+struct audio_key
+{
+  guint64 key[2];
+  GArray *postings;
+};
+
+/* the postings of one file under one hash */
+struct audio_run
+{
+  struct audio_key *key;
+  gsize first;
+  guint count;
+};
+
+struct audio_hit
+{
+  guint file;
+  guint count;
+};
+
+struct audio_index_s
+{
+  GHashTable *keys;
+
+  /* file id -> GArray of its audio_run, NULL without peaks */
+  GPtrArray *files;
+};
+
+static guint audio_key_hash (const struct audio_key *);
+
+static gboolean audio_key_equal (const struct audio_key *,
+                                 const struct audio_key *);
+
+static void audio_key_free (struct audio_key *);
+
+static void audio_runs_free (GArray *);
+
+static gint audio_peak_cmp (const struct audio_peak *,
+                            const struct audio_peak *);
+
+static gint audio_hit_cmp (const struct audio_hit *, const struct audio_hit *);
+
+static gsize audio_index_lower (GArray *, guint);
+
+static GArray *audio_index_runs (audio_index_t *, guint);
+
+audio_index_t *
+audio_index_new ()
+{
+  audio_index_t *index;
+
+  index = g_new0 (audio_index_t, 1);
+  g_return_val_if_fail (index, NULL);
+
+  index->keys = g_hash_table_new_full ((GHashFunc)audio_key_hash,
+                                       (GEqualFunc)audio_key_equal,
+                                       (GDestroyNotify)audio_key_free, NULL);
+  index->files
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)audio_runs_free);
+
+  return index;
+}
+
+void
+audio_index_free (audio_index_t *index)
+{
+  g_ptr_array_free (index->files, TRUE);
+  g_hash_table_destroy (index->keys);
+  g_free (index);
+}
+
+void
+audio_index_add (audio_index_t *index, guint file, hash_array_t *array)
+{
+  gsize i, j, n;
+  audio_peak_hash *peak;
+  struct audio_peak *peaks;
+  struct audio_posting posting[1];
+  struct audio_run run[1];
+  struct audio_key *key, lookup[1];
+  GArray *runs;
+  gchar str[sizeof lookup->key];
+
+  g_return_if_fail (file >= index->files->len);
+
+  while (index->files->len <= file)
+    {
+      g_ptr_array_add (index->files, NULL);
+    }
+
+  n = array ? hash_array_size (array) : 0;
+  if (n == 0)
+    {
+      return;
+    }
+
+  peaks = g_new (struct audio_peak, n);
+  peak = hash_array_data (array);
+  for (i = 0; i < n; ++i, ++peak)
+    {
+      memset (str, 0, sizeof str);
+      strncpy (str, peak->hash, MIN (sizeof str, sizeof peak->hash) - 1);
+      memcpy (peaks[i].key, str, sizeof str);
+      peaks[i].offset = peak->offset;
+    }
+  qsort (peaks, n, sizeof (struct audio_peak),
+         (int (*) (const void *, const void *))audio_peak_cmp);
+
+  runs = g_array_new (FALSE, FALSE, sizeof (struct audio_run));
+  posting->file = file;
+  for (i = 0; i < n; i = j)
+    {
+      memcpy (lookup->key, peaks[i].key, sizeof lookup->key);
+      key = g_hash_table_lookup (index->keys, lookup);
+      if (key == NULL)
+        {
+          key = g_new (struct audio_key, 1);
+          memcpy (key->key, lookup->key, sizeof key->key);
+          key->postings
+              = g_array_new (FALSE, FALSE, sizeof (struct audio_posting));
+          g_hash_table_insert (index->keys, key, key);
+        }
+
+      run->key = key;
+      run->first = key->postings->len;
+      for (j = i; j < n && memcmp (peaks[j].key, peaks[i].key,
+                                   sizeof peaks[i].key) == 0;
+           ++j)
+        {
+          posting->offset = peaks[j].offset;
+          g_array_append_val (key->postings, *posting);
+        }
+      run->count = j - i;
+      g_array_append_val (runs, *run);
+    }
+  g_free (peaks);
+
+  g_ptr_array_index (index->files, file) = runs;
+}
+
+gsize
+audio_index_count (audio_index_t *index, guint file)
+{
+  GArray *runs;
+  gsize i, count;
+
+  runs = audio_index_runs (index, file);
+  if (runs == NULL)
+    {
+      return 0;
+    }
+
+  for (i = 0, count = 0; i < runs->len; ++i)
+    {
+      count += g_array_index (runs, struct audio_run, i).count;
+    }
+
+  return count;
+}
+
+void
+audio_index_similar (audio_index_t *index, guint file, guint lo,
+                     audio_index_func func, gpointer arg)
+{
+  GArray *runs, *array;
+  struct audio_run *run;
+  struct audio_posting *postings;
+  struct audio_hit hit[1], *hits;
+  gsize r, p;
+  guint i, n;
+
+  runs = audio_index_runs (index, file);
+  if (runs == NULL)
+    {
+      return;
+    }
+
+  array = g_array_new (FALSE, FALSE, sizeof (struct audio_hit));
+
+  /* every entry of the lower id counts once towards the higher id when
+   * that holds the same hash, like audio_fingerprint_similarity */
+  for (r = 0; r < runs->len; ++r)
+    {
+      run = &g_array_index (runs, struct audio_run, r);
+      postings = (struct audio_posting *)run->key->postings->data;
+
+      /* the postings of the files before it, from lo on */
+      for (p = audio_index_lower (run->key->postings, lo); p < run->first;
+           p += hit->count)
+        {
+          hit->file = postings[p].file;
+          for (hit->count = 1; p + hit->count < run->first
+                               && postings[p + hit->count].file == hit->file;
+               ++hit->count)
+            ;
+          g_array_append_val (array, *hit);
+        }
+    }
+
+  g_array_sort (array, (GCompareFunc)audio_hit_cmp);
+  hits = (struct audio_hit *)array->data;
+  for (i = 0, n = 0; i < array->len; ++i)
+    {
+      if (n > 0 && hits[n - 1].file == hits[i].file)
+        {
+          hits[n - 1].count += hits[i].count;
+        }
+      else
+        {
+          hits[n++] = hits[i];
+        }
+    }
+
+  for (i = 0; i < n; ++i)
+    {
+      func (hits[i].file, hits[i].count, arg);
+    }
+
+  g_array_free (array, TRUE);
+}
+
+gboolean
+audio_index_align (audio_index_t *index, guint a, guint b, guint need,
+                   gint *delta)
+{
+  GArray *runs;
+  struct audio_run *run;
+  struct audio_posting *postings;
+  GHashTable *votes;
+  gsize r, p, q, first, end;
+  guint count;
+  gint diff;
+  gboolean found;
+
+  runs = audio_index_runs (index, a);
+  if (runs == NULL || audio_index_runs (index, b) == NULL)
+    {
+      return FALSE;
+    }
+
+  votes = g_hash_table_new (g_direct_hash, g_direct_equal);
+  found = FALSE;
+
+  for (r = 0; r < runs->len && !found; ++r)
+    {
+      run = &g_array_index (runs, struct audio_run, r);
+      postings = (struct audio_posting *)run->key->postings->data;
+      end = run->key->postings->len;
+
+      q = audio_index_lower (run->key->postings, b);
+      if (q >= end || postings[q].file != b)
+        {
+          continue;
+        }
+
+      for (p = run->first; p < run->first + run->count && !found; ++p)
+        {
+          for (first = q; first < end && postings[first].file == b; ++first)
+            {
+              diff = postings[first].offset - postings[p].offset;
+              count = GPOINTER_TO_UINT (
+                          g_hash_table_lookup (votes, GINT_TO_POINTER (diff)))
+                      + 1;
+              if (count >= need)
+                {
+                  *delta = diff;
+                  found = TRUE;
+                  break;
+                }
+              g_hash_table_insert (votes, GINT_TO_POINTER (diff),
+                                   GUINT_TO_POINTER (count));
+            }
+        }
+    }
+
+  g_hash_table_destroy (votes);
+
+  return found;
+}
+
+static GArray *
+audio_index_runs (audio_index_t *index, guint file)
+{
+  if (file >= index->files->len)
+    {
+      return NULL;
+    }
+
+  return g_ptr_array_index (index->files, file);
+}
+
+/* first posting whose file is not below file */
+static gsize
+audio_index_lower (GArray *array, guint file)
+{
+  struct audio_posting *postings;
+  gsize from, end, mid;
+
+  postings = (struct audio_posting *)array->data;
+  from = 0;
+  end = array->len;
+  while (from < end)
+    {
+      mid = from + (end - from) / 2;
+      if (postings[mid].file < file)
+        {
+          from = mid + 1;
+        }
+      else
+        {
+          end = mid;
+        }
+    }
+
+  return from;
+}
+
+static guint
+audio_key_hash (const struct audio_key *key)
+{
+  guint64 h;
+
+  h = (key->key[0] ^ (key->key[1] * 0x9E3779B97F4A7C15ULL))
+      * 0xC2B2AE3D27D4EB4FULL;
+
+  return (guint)(h >> 32);
+}
+
+static gboolean
+audio_key_equal (const struct audio_key *a, const struct audio_key *b)
+{
+  return a->key[0] == b->key[0] && a->key[1] == b->key[1];
+}
+
+static void
+audio_key_free (struct audio_key *key)
+{
+  g_array_free (key->postings, TRUE);
+  g_free (key);
+}
+
+static void
+audio_runs_free (GArray *runs)
+{
+  if (runs)
+    {
+      g_array_free (runs, TRUE);
+    }
+}
+
+static gint
+audio_peak_cmp (const struct audio_peak *a, const struct audio_peak *b)
+{
+  int i;
+
+  for (i = 0; i < 2; ++i)
+    {
+      if (a->key[i] != b->key[i])
+        {
+          return a->key[i] < b->key[i] ? -1 : 1;
+        }
+    }
+
+  if (a->offset != b->offset)
+    {
+      return a->offset < b->offset ? -1 : 1;
+    }
+
+  return 0;
+}
+
+static gint
+audio_hit_cmp (const struct audio_hit *a, const struct audio_hit *b)
+{
+  if (a->file != b->file)
+    {
+      return a->file < b->file ? -1 : 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE audio_index.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_AUDIO_INDEX_H_
+#define _FDUPVES_AUDIO_INDEX_H_
+
+#include "audio.h"
+#include "hash.h"
+
+#include <glib.h>
+
+/* seconds of one peak offset, the fingerprint hop of 2048 samples at
+ * 22050 Hz */
+#ifndef AUDIO_INDEX_FRAME
+#define AUDIO_INDEX_FRAME (2048.0f / 22050.0f)
+#endif
+
+/* inverted index: peak hash -> (file, offset) postings of every file,
+ * a lookup costs the hash collisions of one file instead of a
+ * compare against every other file.
+ * files are added one by one, so lookups work while a scan still runs.
+ */
+typedef struct audio_index_s audio_index_t;
+
+/* other file id, and what audio_fingerprint_similarity (lower id,
+ * higher id) would return */
+typedef void (*audio_index_func) (guint, guint, gpointer);
+
+audio_index_t *audio_index_new ();
+
+void audio_index_free (audio_index_t *);
+
+/* ids must be added in ascending order, not thread safe against
+ * lookups */
+void audio_index_add (audio_index_t *, guint, hash_array_t *);
+
+gsize audio_index_count (audio_index_t *, guint);
+
+/* report every file id from lo below file sharing a peak hash with it,
+ * in ascending order */
+void audio_index_similar (audio_index_t *, guint, guint lo,
+                          audio_index_func, gpointer);
+
+/* vote the offset differences of the hashes shared by two files, stop
+ * as soon as one difference gets need votes and return TRUE with it in
+ * delta, b's offset minus a's offset */
+gboolean audio_index_align (audio_index_t *, guint a, guint b, guint need,
+                            gint *delta);
+
+#endif
@@ -49,14 +49,43 @@ cache_t *g_cache;
 struct cache_s {
     sqlite3 *db;
     gchar *file;
+
+    /* one connection for every thread: held around each statement, and
+     * from cache_begin to cache_commit so a transaction is not mixed with
+     * the statements of other threads */
+    GRecMutex lock;
 };
 
 static gboolean cache_exec(cache_t *cache, int (*cb)(void *, int, char **, char **), void *arg, const char *fmt, ...);
 
+struct cache_media {
+    int id;
+    gint64 size;
+    gint64 mtime;
+};
+
+struct cache_words {
+    hash_t *words;
+    int n;
+    gboolean found;
+};
+
+struct cache_walk {
+    cache_file_func file_func;
+    cache_pair_func pair_func;
+    gpointer arg;
+};
+
 const char *init_text = "create table media(id INTEGER PRIMARY KEY AUTOINCREMENT, path text, size bigint, mtime bigint);"
                         "create table hash(id INTEGER PRIMARY KEY AUTOINCREMENT, media_id integer, alg int, offset real, hash varchar(32));"
                         "create unique index index_path on media (path);";
 
+/* what the last scan saw, kept apart from the hashes */
+const char *scan_text = "drop table if exists scan_file;"
+                        "create table if not exists scan_media(path text primary key, size bigint, mtime bigint, length real);"
+                        "create table if not exists scan_pair(a text, b text, type int, offset real);"
+                        "create table if not exists scan_value(key text primary key, value text);";
+
 static void
 cache_init(cache_t *cache) {
     cache_exec(cache, NULL, NULL, init_text);
@@ -72,6 +101,7 @@ cache_open(const gchar *file) {
     g_return_val_if_fail(cache, NULL);
 
     cache->file = g_strdup(file);
+    g_rec_mutex_init(&cache->lock);
 
     needInit = FALSE;
     if (g_file_test(file, G_FILE_TEST_EXISTS) == FALSE) {
@@ -83,6 +113,8 @@ cache_open(const gchar *file) {
 
     if (sqlite3_open(file, &cache->db) != 0) {
         g_warning("Open cache file: %s failed:%s.", file, strerror(errno));
+        g_rec_mutex_clear(&cache->lock);
+        g_free(cache->file);
         g_free(cache);
         return NULL;
     }
@@ -90,6 +122,7 @@ cache_open(const gchar *file) {
     if (needInit) {
         cache_init(cache);
     }
+    cache_exec(cache, NULL, NULL, scan_text);
 
     if (g_cache == NULL) {
         g_cache = cache;
@@ -101,6 +134,7 @@ cache_open(const gchar *file) {
 void
 cache_close(cache_t *cache) {
     sqlite3_close(cache->db);
+    g_rec_mutex_clear(&cache->lock);
     g_free(cache->file);
     g_free(cache);
 }
@@ -109,19 +143,25 @@ static gboolean
 cache_exec(cache_t *cache, int (*cb)(void *, int, char **, char **), void *arg, const char *fmt, ...) {
     int rc;
     va_list ap;
-    char text[1024], *errMsg;
+    char *text, *errMsg;
 
+    /* sqlite3 printf, %q quotes the paths */
     va_start(ap, fmt);
-    vsnprintf(text, sizeof text, fmt, ap);
+    text = sqlite3_vmprintf(fmt, ap);
     va_end(ap);
+    g_return_val_if_fail(text, FALSE);
 
+    g_rec_mutex_lock(&cache->lock);
     rc = sqlite3_exec(cache->db, text, cb, arg, &errMsg);
+    g_rec_mutex_unlock(&cache->lock);
     if (rc != SQLITE_OK) {
         g_warning("SQL error: %s in [%s]\n", errMsg, text);
         sqlite3_free(errMsg);
+        sqlite3_free(text);
         return FALSE;
     }
 
+    sqlite3_free(text);
     return TRUE;
 }
 
@@ -133,6 +173,69 @@ get_id_callback(void *para, int n_column, char **column_value, char **column_nam
     return 0;
 }
 
+static int
+get_media_callback(void *para, int n_column, char **column_value, char **column_name) {
+    struct cache_media *media = (struct cache_media *) para;
+    if (column_value[0] != NULL) {
+        media->id = atoi(column_value[0]);
+        media->size = column_value[1] ? g_ascii_strtoll(column_value[1], NULL, 10) : -1;
+        media->mtime = column_value[2] ? g_ascii_strtoll(column_value[2], NULL, 10) : -1;
+    }
+    return 0;
+}
+
+static int
+get_value_callback(void *para, int n_column, char **column_value, char **column_name) {
+    gchar **vp = (gchar **) para;
+    if (column_value[0] != NULL) {
+        g_free(*vp);
+        *vp = g_strdup(column_value[0]);
+    }
+    return 0;
+}
+
+static int
+scan_file_callback(void *para, int n_column, char **column_value, char **column_name) {
+    struct cache_walk *walk = (struct cache_walk *) para;
+    if (column_value[0] != NULL) {
+        walk->file_func(column_value[0],
+                        column_value[1] ? g_ascii_strtoll(column_value[1], NULL, 10) : -1,
+                        column_value[2] ? g_ascii_strtoll(column_value[2], NULL, 10) : -1,
+                        column_value[3] ? (float) g_ascii_strtod(column_value[3], NULL) : 0,
+                        walk->arg);
+    }
+    return 0;
+}
+
+static int
+scan_pair_callback(void *para, int n_column, char **column_value, char **column_name) {
+    struct cache_walk *walk = (struct cache_walk *) para;
+    if (column_value[0] != NULL && column_value[1] != NULL) {
+        walk->pair_func(column_value[0], column_value[1],
+                        column_value[2] ? atoi(column_value[2]) : 0,
+                        column_value[3] ? (float) g_ascii_strtod(column_value[3], NULL) : 0,
+                        walk->arg);
+    }
+    return 0;
+}
+
+static int
+get_words_callback(void *para, int n_column, char **column_value, char **column_name) {
+    struct cache_words *words = (struct cache_words *) para;
+    gchar word[17];
+    int i;
+
+    if (column_value[0] != NULL && strlen(column_value[0]) == (gsize) words->n * 16) {
+        word[16] = '\0';
+        for (i = 0; i < words->n; ++i) {
+            memcpy(word, column_value[0] + i * 16, 16);
+            words->words[i] = g_ascii_strtoull(word, NULL, 16);
+        }
+        words->found = TRUE;
+    }
+    return 0;
+}
+
 static int
 get_hash_callback(void *para, int n_column, char **column_value, char **column_name) {
     hash_t *hp = (hash_t *) para;
@@ -149,7 +252,7 @@ get_hash_array_callback(void *para, int n_column, char **column_value, char **co
 
     if (column_value[1] != NULL) {
         if (*pHashArray == NULL) {
-            *pHashArray = hash_array_new();
+            *pHashArray = hash_array_new(FDUPVES_AUDIO_HASH, sizeof(audio_peak_hash));
         }
         if (*pHashArray == NULL) {
             g_warning("hash array new error: %s", strerror(errno));
@@ -158,7 +261,7 @@ get_hash_array_callback(void *para, int n_column, char **column_value, char **co
 
         hash.offset = (int) strtof(column_value[0], NULL);
         snprintf(hash.hash, sizeof hash.hash, "%s", column_value[1]);
-        hash_array_append(*pHashArray, &hash, sizeof(audio_peak_hash));
+        hash_array_append(*pHashArray, &hash);
     }
 
     return 0;
@@ -166,40 +269,41 @@ get_hash_array_callback(void *para, int n_column, char **column_value, char **co
 
 static int
 cache_get_media_id(cache_t *cache, const gchar *file) {
-    int media_id;
+    struct cache_media media[1];
+    gint64 size, mtime;
     gboolean ret;
 
-    media_id = -1;
+    if (!cache_stat(file, &size, &mtime)) {
+        g_warning("stat error: %s", strerror(errno));
+        return -1;
+    }
 
-    ret = cache_exec(cache, get_id_callback, &media_id,
-                     "select id from media where path='%s';", file);
+    media->id = -1;
+    ret = cache_exec(cache, get_media_callback, media,
+                     "select id, size, mtime from media where path='%q';", file);
     g_return_val_if_fail(ret, -1);
 
-    if (media_id == -1) {
-        GStatBuf buf[1];
-        if (g_stat(file, buf) != 0) {
-            g_warning("stat error: %s", strerror(errno));
-            return -1;
-        }
+    if (media->id == -1) {
+        ret = cache_exec(cache, NULL, NULL,
+                         "insert into media(path, size, mtime) values('%q', %lld, %lld);",
+                         file, (long long) size, (long long) mtime);
+        g_return_val_if_fail(ret, -1);
 
-#if WIN32
-        ret = cache_exec (
-            cache, NULL, NULL,
-            "insert into media(path, size, mtime) values('%s', %ld, %ld);",
-            file, buf->st_size, buf->st_mtime);
-#else
+        ret = cache_exec(cache, get_id_callback, &media->id,
+                         "select id from media where path='%q';", file);
+        g_return_val_if_fail(ret, -1);
+    }
+    else if (media->size != size || media->mtime != mtime) {
+        /* the file changed since it was hashed, its hashes are stale */
+        cache_exec(cache, NULL, NULL,
+                   "delete from hash where media_id=%d;", media->id);
         ret = cache_exec(cache, NULL, NULL,
-                         "insert into media(path, size, mtime) values('%s', %ld, %ld);",
-                         file, buf->st_size, buf->st_mtim.tv_sec);
-#endif
+                         "update media set size=%lld, mtime=%lld where id=%d;",
+                         (long long) size, (long long) mtime, media->id);
         g_return_val_if_fail(ret, -1);
     }
 
-    ret = cache_exec(cache, get_id_callback, &media_id,
-                     "select id from media where path='%s';", file);
-    g_return_val_if_fail(ret, -1);
-
-    return media_id;
+    return media->id;
 }
 
 gboolean
@@ -213,7 +317,7 @@ cache_get(cache_t *cache, const gchar *file, float off, int alg, hash_t *hp) {
     *hp = 0;
     ret = cache_exec(cache, get_hash_callback, hp,
                      "select hash from hash where offset=%f and alg=%d and media_id=%d",
-                     off, alg, media_id);
+                     (double) off, alg, media_id);
     g_return_val_if_fail(ret, FALSE);
 
     return *hp != 0;
@@ -229,7 +333,49 @@ cache_set(cache_t *cache, const gchar *file, float off, int alg, hash_t h) {
 
     ret = cache_exec(cache, NULL, NULL,
                      "insert into hash(media_id, offset, alg, hash) values(%d, %f, %d, '%lld')",
-                     media_id, off, alg, h);
+                     media_id, (double) off, alg, h);
+    g_return_val_if_fail(ret, FALSE);
+
+    return TRUE;
+}
+
+gboolean
+cache_get_words(cache_t *cache, const gchar *file, float off, int alg, hash_t *hs, int n) {
+    struct cache_words words[1];
+    int media_id;
+    gboolean ret;
+
+    media_id = cache_get_media_id(cache, file);
+    g_return_val_if_fail(media_id != -1, FALSE);
+
+    words->words = hs;
+    words->n = n;
+    words->found = FALSE;
+    ret = cache_exec(cache, get_words_callback, words,
+                     "select hash from hash where offset=%f and alg=%d and media_id=%d",
+                     (double) off, alg, media_id);
+    g_return_val_if_fail(ret, FALSE);
+
+    return words->found;
+}
+
+gboolean
+cache_set_words(cache_t *cache, const gchar *file, float off, int alg, const hash_t *hs, int n) {
+    GString *text;
+    int media_id, i;
+    gboolean ret;
+
+    media_id = cache_get_media_id(cache, file);
+    g_return_val_if_fail(media_id != -1, FALSE);
+
+    text = g_string_sized_new(n * 16);
+    for (i = 0; i < n; ++i) {
+        g_string_append_printf(text, "%016llx", hs[i]);
+    }
+    ret = cache_exec(cache, NULL, NULL,
+                     "insert into hash(media_id, offset, alg, hash) values(%d, %f, %d, '%q')",
+                     media_id, (double) off, alg, text->str);
+    g_string_free(text, TRUE);
     g_return_val_if_fail(ret, FALSE);
 
     return TRUE;
@@ -254,18 +400,20 @@ cache_gets(cache_t *cache, const gchar *file, int alg, hash_array_t **pHashArray
 
 gboolean
 cache_sets(cache_t *cache, const gchar *file, int alg, hash_array_t *hashArray) {
-    int media_id, i;
-    audio_peak_hash *hash;
+    int media_id;
+    gsize i, n;
+    audio_peak_hash *hashs;
     gboolean ret;
 
     media_id = cache_get_media_id(cache, file);
     g_return_val_if_fail(media_id != -1, FALSE);
 
-    for (i = 0; i < hash_array_size(hashArray); ++i) {
-        hash = hash_array_index(hashArray, i);
+    hashs = hash_array_data(hashArray);
+    n = hash_array_size(hashArray);
+    for (i = 0; i < n; ++i) {
         ret = cache_exec(cache, NULL, NULL,
-                         "insert into hash(media_id, offset, alg, hash) values(%d, %d, %d, '%s')",
-                         media_id, hash->offset, alg, hash->hash);
+                         "insert into hash(media_id, offset, alg, hash) values(%d, %d, %d, '%q')",
+                         media_id, hashs[i].offset, alg, hashs[i].hash);
         g_return_val_if_fail(ret, FALSE);
     }
 
@@ -276,8 +424,13 @@ gboolean
 cache_remove(cache_t *cache, const gchar *file) {
     int media_id;
 
-    media_id = cache_get_media_id(cache, file);
-    g_return_val_if_fail(media_id != -1, FALSE);
+    /* no stat, the file may be gone already */
+    media_id = -1;
+    cache_exec(cache, get_id_callback, &media_id,
+               "select id from media where path='%q';", file);
+    if (media_id == -1) {
+        return FALSE;
+    }
 
     cache_exec(cache, NULL, NULL,
                "delete from hash where media_id=%d;",
@@ -316,3 +469,92 @@ cache_cleanup(cache_t *cache) {
     cache_exec(cache, cache_remove_if_no_exists_callback, cache,
                "select id, path from media;");
 }
+
+gboolean
+cache_stat(const gchar *file, gint64 *size, gint64 *mtime) {
+    GStatBuf buf[1];
+
+    if (g_stat(file, buf) != 0) {
+        return FALSE;
+    }
+
+    *size = (gint64) buf->st_size;
+    *mtime = (gint64) buf->st_mtime;
+
+    return TRUE;
+}
+
+gboolean
+cache_begin(cache_t *cache) {
+    g_rec_mutex_lock(&cache->lock);
+    return cache_exec(cache, NULL, NULL, "begin transaction;");
+}
+
+/* ends the transaction of cache_begin, whether it started or not */
+gboolean
+cache_commit(cache_t *cache) {
+    gboolean ret;
+
+    ret = cache_exec(cache, NULL, NULL, "commit transaction;");
+    g_rec_mutex_unlock(&cache->lock);
+
+    return ret;
+}
+
+gchar *
+cache_get_value(cache_t *cache, const gchar *key) {
+    gchar *value;
+
+    value = NULL;
+    cache_exec(cache, get_value_callback, &value,
+               "select value from scan_value where key='%q';", key);
+
+    return value;
+}
+
+gboolean
+cache_set_value(cache_t *cache, const gchar *key, const gchar *value) {
+    return cache_exec(cache, NULL, NULL,
+                      "insert or replace into scan_value(key, value) values('%q', '%q');",
+                      key, value);
+}
+
+void
+cache_scan_files(cache_t *cache, cache_file_func func, gpointer arg) {
+    struct cache_walk walk[1];
+
+    walk->file_func = func;
+    walk->arg = arg;
+    cache_exec(cache, scan_file_callback, walk,
+               "select path, size, mtime, length from scan_media;");
+}
+
+void
+cache_scan_pairs(cache_t *cache, cache_pair_func func, gpointer arg) {
+    struct cache_walk walk[1];
+
+    walk->pair_func = func;
+    walk->arg = arg;
+    cache_exec(cache, scan_pair_callback, walk,
+               "select a, b, type, offset from scan_pair;");
+}
+
+gboolean
+cache_scan_clear(cache_t *cache) {
+    return cache_exec(cache, NULL, NULL,
+                      "delete from scan_media; delete from scan_pair;");
+}
+
+gboolean
+cache_scan_add_file(cache_t *cache, const gchar *path, gint64 size, gint64 mtime, float length) {
+    return cache_exec(cache, NULL, NULL,
+                      "insert or replace into scan_media(path, size, mtime, length) values('%q', %lld, %lld, %f);",
+                      path, (long long) size, (long long) mtime, (double) length);
+}
+
+gboolean
+cache_scan_add_pair(cache_t *cache, const gchar *a, const gchar *b, int type, float offset) {
+    return cache_exec(cache, NULL, NULL,
+                      "insert into scan_pair(a, b, type, offset) values('%q', '%q', %d, %f);",
+                      a, b, type, (double) offset);
+}
@@ -41,6 +41,11 @@ gboolean cache_get(cache_t *, const gchar *, float, int, hash_t *);
 
 gboolean cache_set(cache_t *, const gchar *, float, int, hash_t);
 
+/* a signature of several hash_t, as one hex string */
+gboolean cache_get_words(cache_t *, const gchar *, float, int, hash_t *, int);
+
+gboolean cache_set_words(cache_t *, const gchar *, float, int, const hash_t *, int);
+
 gboolean cache_gets(cache_t *, const gchar *, int alg, hash_array_t **);
 
 gboolean cache_sets(cache_t *, const gchar *, int alg, hash_array_t *);
@@ -49,6 +54,34 @@ gboolean cache_remove(cache_t *, const gchar *);
 
 void cache_cleanup(cache_t *);
 
+/* size and mtime, as kept for every media */
+gboolean cache_stat(const gchar *, gint64 *size, gint64 *mtime);
+
+gboolean cache_begin(cache_t *);
+
+gboolean cache_commit(cache_t *);
+
+/* newly allocated, NULL when unset */
+gchar *cache_get_value(cache_t *, const gchar *key);
+
+gboolean cache_set_value(cache_t *, const gchar *key, const gchar *value);
+
+/* the files and pairs of the last scan, for incremental rescans; length
+ * is 0 for the files without one */
+typedef void (*cache_file_func)(const gchar *path, gint64 size, gint64 mtime, float length, gpointer);
+
+typedef void (*cache_pair_func)(const gchar *a, const gchar *b, int type, float offset, gpointer);
+
+void cache_scan_files(cache_t *, cache_file_func, gpointer);
+
+void cache_scan_pairs(cache_t *, cache_pair_func, gpointer);
+
+gboolean cache_scan_clear(cache_t *);
+
+gboolean cache_scan_add_file(cache_t *, const gchar *, gint64 size, gint64 mtime, float length);
+
+gboolean cache_scan_add_pair(cache_t *, const gchar *, const gchar *, int type, float offset);
+
 extern cache_t *g_cache;
 
 #endif
@@ -0,0 +1,329 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE cli.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "cli.h"
+#include "cache.h"
+#include "find.h"
+#include "ini.h"
+#include "jsonl.h"
+#include "util.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* microseconds between two progress lines */
+#ifndef FD_CLI_TICK
+#define FD_CLI_TICK 500000
+#endif
+
+struct cli_s
+{
+  /* files of every type, FD_IMAGE ... FD_EBOOK */
+  GPtrArray *files[FD_EBOOK + 1];
+  gboolean types[FD_EBOOK + 1];
+
+  /* json lines sink, it takes the place of the text lines on stdout */
+  jsonl_t *jsonl;
+  FILE *jsonl_fp;
+
+  gboolean progress;
+  gint64 last;
+  GMutex lock;
+};
+
+typedef struct cli_s cli_t;
+
+static gboolean cli_parse_types (cli_t *, const gchar *);
+
+static void cli_add_file (const gchar *, cli_t *);
+
+static void cli_step_cb (const find_step *, cli_t *);
+
+gboolean
+cli_wanted (int argc, char *argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; ++i)
+    {
+      if (strcmp (argv[i], "--scan") == 0)
+        {
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+int
+cli_main (int argc, char *argv[])
+{
+  cli_t cli[1];
+  gboolean scan;
+  gchar *types, *json, **dirs;
+  GOptionContext *context;
+  GError *err;
+  int i, count;
+  const GOptionEntry entries[] = {
+    { "scan", 0, 0, G_OPTION_ARG_NONE, &scan,
+      "Find the same files in DIR... without the GUI", NULL },
+    { "type", 0, 0, G_OPTION_ARG_STRING, &types,
+      "Media types to find: image,video,audio,ebook", "TYPES" },
+    { "jsonl", 0, 0, G_OPTION_ARG_FILENAME, &json,
+      "Write the pairs and groups as JSON lines to FILE, - for stdout",
+      "FILE" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &dirs, NULL,
+      "DIR..." },
+    { NULL },
+  };
+
+  scan = FALSE;
+  types = NULL;
+  json = NULL;
+  dirs = NULL;
+  context = g_option_context_new ("- find the same files");
+  g_option_context_add_main_entries (context, entries, PACKAGE);
+
+  err = NULL;
+  if (!g_option_context_parse (context, &argc, &argv, &err))
+    {
+      g_printerr ("%s\n", err->message);
+      g_error_free (err);
+      g_option_context_free (context);
+      return 2;
+    }
+  g_option_context_free (context);
+
+  if (dirs == NULL)
+    {
+      g_printerr ("%s\n", "no directory to scan");
+      g_free (types);
+      g_free (json);
+      return 2;
+    }
+
+  memset (cli, 0, sizeof cli);
+  if (!cli_parse_types (cli, types ? types : "image,video,audio,ebook"))
+    {
+      g_printerr ("unknown type in: %s\n", types);
+      g_free (types);
+      g_free (json);
+      g_strfreev (dirs);
+      return 2;
+    }
+  g_free (types);
+
+  if (json)
+    {
+      cli->jsonl_fp = strcmp (json, "-") == 0 ? stdout : fopen (json, "w");
+      if (cli->jsonl_fp == NULL)
+        {
+          g_printerr ("Can't open %s: %s\n", json, g_strerror (errno));
+          g_free (json);
+          g_strfreev (dirs);
+          return 2;
+        }
+      cli->jsonl = jsonl_new (cli->jsonl_fp);
+      g_free (json);
+    }
+
+  if (ini_new_with_file (FD_USR_CONF_FILE) == NULL)
+    {
+      ini_new ();
+    }
+  cache_open (g_ini->cache_file);
+
+  g_mutex_init (&cli->lock);
+  cli->progress = isatty (fileno (stderr));
+  for (i = FD_IMAGE; i <= FD_EBOOK; ++i)
+    {
+      cli->files[i] = g_ptr_array_new_with_free_func (g_free);
+    }
+  for (i = 0; dirs[i]; ++i)
+    {
+      fd_walk (dirs[i], NULL, (fd_walk_func)cli_add_file, cli);
+    }
+  g_strfreev (dirs);
+
+  count = 0;
+  if (cli->files[FD_IMAGE]->len > 0)
+    {
+      count += find_images (cli->files[FD_IMAGE], NULL,
+                            (find_step_cb)cli_step_cb, cli);
+    }
+  if (cli->files[FD_VIDEO]->len > 0)
+    {
+      count += find_videos (cli->files[FD_VIDEO], NULL,
+                            (find_step_cb)cli_step_cb, cli);
+    }
+  if (cli->files[FD_AUDIO]->len > 0)
+    {
+      count += find_audios (cli->files[FD_AUDIO], NULL,
+                            (find_step_cb)cli_step_cb, cli);
+    }
+  if (cli->files[FD_EBOOK]->len > 0)
+    {
+      count += find_ebooks (cli->files[FD_EBOOK], NULL,
+                            (find_step_cb)cli_step_cb, cli);
+    }
+
+  if (cli->progress)
+    {
+      g_printerr ("\n");
+    }
+  g_message ("find %d same pairs", count);
+
+  if (cli->jsonl)
+    {
+      jsonl_finish (cli->jsonl);
+      jsonl_free (cli->jsonl);
+      if (cli->jsonl_fp != stdout)
+        {
+          fclose (cli->jsonl_fp);
+        }
+    }
+
+  for (i = FD_IMAGE; i <= FD_EBOOK; ++i)
+    {
+      g_ptr_array_free (cli->files[i], TRUE);
+    }
+  g_mutex_clear (&cli->lock);
+
+  if (g_cache)
+    {
+      cache_close (g_cache);
+    }
+
+  return 0;
+}
+
+static gboolean
+cli_parse_types (cli_t *cli, const gchar *text)
+{
+  gchar **names;
+  int i;
+  gboolean ok;
+
+  ok = TRUE;
+  names = g_strsplit (text, ",", -1);
+  for (i = 0; names[i]; ++i)
+    {
+      g_strstrip (names[i]);
+      if (strcmp (names[i], "image") == 0)
+        {
+          cli->types[FD_IMAGE] = TRUE;
+        }
+      else if (strcmp (names[i], "video") == 0)
+        {
+          cli->types[FD_VIDEO] = TRUE;
+        }
+      else if (strcmp (names[i], "audio") == 0)
+        {
+          cli->types[FD_AUDIO] = TRUE;
+        }
+      else if (strcmp (names[i], "ebook") == 0)
+        {
+          cli->types[FD_EBOOK] = TRUE;
+        }
+      else if (names[i][0])
+        {
+          ok = FALSE;
+        }
+    }
+  g_strfreev (names);
+
+  return ok;
+}
+
+static void
+cli_add_file (const gchar *path, cli_t *cli)
+{
+  int type;
+
+  if (is_image (path))
+    {
+      type = FD_IMAGE;
+    }
+  else if (is_video (path))
+    {
+      type = FD_VIDEO;
+    }
+  else if (is_audio (path))
+    {
+      type = FD_AUDIO;
+    }
+  else if (is_ebook (path))
+    {
+      type = FD_EBOOK;
+    }
+  else
+    {
+      return;
+    }
+
+  if (cli->types[type])
+    {
+      g_ptr_array_add (cli->files[type], fd_realpath (path));
+    }
+}
+
+/* pairs go to stdout as they come, the progress to a terminal at most
+ * every FD_CLI_TICK */
+static void
+cli_step_cb (const find_step *step, cli_t *cli)
+{
+  gint64 now;
+
+  g_mutex_lock (&cli->lock);
+  if (cli->jsonl)
+    {
+      jsonl_step (cli->jsonl, step);
+    }
+
+  if (step->found)
+    {
+      if (cli->jsonl_fp != stdout)
+        {
+          printf ("%s\t%s\t%s\n", find_type_name (step->type), step->afile,
+                  step->bfile);
+          fflush (stdout);
+        }
+    }
+  else if (cli->progress && step->total > 0)
+    {
+      now = g_get_monotonic_time ();
+      if (now - cli->last >= FD_CLI_TICK)
+        {
+          cli->last = now;
+          g_printerr ("\r%s %ld/%ld", step->doing ? step->doing : "",
+                      step->now, step->total);
+        }
+    }
+  g_mutex_unlock (&cli->lock);
+}
@@ -0,0 +1,379 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE compare.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "compare.h"
+#include "ini.h"
+#include "util.h"
+
+#include <glib.h>
+
+struct compare_engine
+{
+  compare_task_func func;
+  gpointer data;
+  gsize count;
+  GCancellable *cancel;
+
+  /* next task to take, tasks finished */
+  volatile gint next;
+  volatile gint done;
+
+  /* one match buffer per worker */
+  GArray **outs;
+};
+
+static gboolean compare_engine_run (struct compare_engine *, gsize);
+
+static void compare_engine_worker (gpointer, struct compare_engine *);
+
+static gint compare_match_cmp (const compare_match *, const compare_match *);
+
+static int distance_to_same_peak_count (gulong, gulong, int);
+
+/* run tasks 0..count-1 on threads_count threads, the calling thread is
+ * one of them and reports the progress, the matches come back merged and
+ * sorted by (a, b). once cancel is set no task starts any more */
+GArray *
+compare_tasks (gsize count, compare_task_func func, gpointer data,
+               GCancellable *cancel, find_step *step, find_step_cb cb,
+               gpointer arg)
+{
+  struct compare_engine engine[1];
+  GThreadPool *pool;
+  GArray *matches;
+  gsize i, workers;
+
+  engine->func = func;
+  engine->data = data;
+  engine->count = count;
+  engine->cancel = cancel;
+  engine->next = 0;
+  engine->done = 0;
+
+  workers = g_ini->threads_count > 1 ? (gsize)g_ini->threads_count : 1;
+  workers = MIN (workers, MAX (count, 1));
+  engine->outs = g_new (GArray *, workers);
+  for (i = 0; i < workers; ++i)
+    {
+      engine->outs[i]
+          = g_array_new (FALSE, FALSE, sizeof (compare_match));
+    }
+
+  pool = NULL;
+  if (workers > 1)
+    {
+      pool = g_thread_pool_new ((GFunc)compare_engine_worker, engine,
+                                (gint)workers - 1, FALSE, NULL);
+    }
+  if (pool)
+    {
+      for (i = 1; i < workers; ++i)
+        {
+          g_thread_pool_push (pool, GSIZE_TO_POINTER (i), NULL);
+        }
+    }
+
+  step->found = FALSE;
+  step->removed = FALSE;
+  step->total = count;
+  step->now = 0;
+  while (compare_engine_run (engine, 0))
+    {
+      step->now = g_atomic_int_get (&engine->done);
+      cb (step, arg);
+    }
+
+  if (pool)
+    {
+      g_thread_pool_free (pool, FALSE, TRUE);
+    }
+
+  matches = engine->outs[0];
+  for (i = 1; i < workers; ++i)
+    {
+      g_array_append_vals (matches, engine->outs[i]->data,
+                           engine->outs[i]->len);
+      g_array_free (engine->outs[i], TRUE);
+    }
+  g_free (engine->outs);
+
+  /* report in the same order as comparing every pair on one thread */
+  g_array_sort (matches, (GCompareFunc)compare_match_cmp);
+
+  step->now = count;
+  cb (step, arg);
+
+  return matches;
+}
+
+int
+compare_report (GArray *matches, const gchar **paths, find_step *step,
+                find_step_cb cb, gpointer arg)
+{
+  guint i;
+  compare_match *match;
+
+  for (i = 0; i < matches->len; ++i)
+    {
+      match = &g_array_index (matches, compare_match, i);
+      step->afile = paths[match->a];
+      step->bfile = paths[match->b];
+      step->found = TRUE;
+      step->type = match->type;
+      step->offset = match->offset;
+      step->distance = match->distance;
+      cb (step, arg);
+    }
+  step->found = FALSE;
+  step->offset = 0;
+  step->distance = -1;
+
+  return (int)matches->len;
+}
+
+same_type
+compare_exact_type (int type)
+{
+  switch (type)
+    {
+    case FD_VIDEO:
+      return FD_SAME_VIDEO_HEAD;
+
+    case FD_AUDIO:
+      return FD_SAME_AUDIO_HEAD;
+
+    case FD_EBOOK:
+      return FD_SAME_EBOOK;
+
+    default:
+      return FD_SAME_IMAGE;
+    }
+}
+
+float
+compare_length_max (float length)
+{
+  static const int rates[] = { 0, 1, 2, 10, 20, 100 };
+
+  if (g_ini->filter_time_rate == 0)
+    {
+      return G_MAXFLOAT;
+    }
+
+  return length * (float)(rates[g_ini->filter_time_rate] + 1);
+}
+
+/* judge two audio files sharing peak hashes, shared is the
+ * audio_index_similar count of a < b */
+gboolean
+compare_audio (audio_index_t *peaks, guint a, guint b, guint shared,
+               float alen, float blen, compare_match *match)
+{
+  int peak_count;
+  gint delta;
+  float pos, room;
+  gsize asize, bsize;
+
+  if (compare_length_max (MIN (alen, blen)) < MAX (alen, blen))
+    {
+      g_debug ("length %f and length %f, filtered", alen, blen);
+      return FALSE;
+    }
+
+  asize = audio_index_count (peaks, a);
+  bsize = audio_index_count (peaks, b);
+  peak_count = distance_to_same_peak_count (asize, bsize,
+                                            g_ini->same_audio_distance);
+  g_debug ("distance: %d, peaks %lu and %lu, need %d, dist: %u",
+           g_ini->same_audio_distance, asize, bsize, peak_count, shared);
+  if ((int)shared < peak_count)
+    {
+      return FALSE;
+    }
+
+  match->a = a;
+  match->b = b;
+  match->type = FD_SAME_AUDIO_HEAD;
+  match->offset = 0;
+  match->orient = 0;
+  match->distance = -1;
+
+  /* the shared hash count bounds every offset bin, so only the pairs
+   * passing it are voted */
+  if (g_ini->audio_align)
+    {
+      if (!audio_index_align (peaks, a, b, peak_count, &delta))
+        {
+          return FALSE;
+        }
+
+      /* where the shorter track sits inside the longer one */
+      match->offset = (float)delta * AUDIO_INDEX_FRAME;
+      if (alen <= blen)
+        {
+          pos = match->offset;
+          room = blen - alen;
+        }
+      else
+        {
+          pos = -match->offset;
+          room = alen - blen;
+        }
+      if (pos * 2 > room)
+        {
+          match->type = FD_SAME_AUDIO_TAIL;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+compare_engine_run (struct compare_engine *engine, gsize worker)
+{
+  gsize task;
+
+  if (g_cancellable_is_cancelled (engine->cancel))
+    {
+      return FALSE;
+    }
+
+  task = (gsize)g_atomic_int_add (&engine->next, 1);
+  if (task >= engine->count)
+    {
+      return FALSE;
+    }
+
+  engine->func (task, engine->data, engine->outs[worker]);
+  g_atomic_int_inc (&engine->done);
+
+  return TRUE;
+}
+
+static void
+compare_engine_worker (gpointer item, struct compare_engine *engine)
+{
+  gsize worker;
+
+  worker = GPOINTER_TO_SIZE (item);
+  while (compare_engine_run (engine, worker))
+    ;
+}
+
+static gint
+compare_match_cmp (const compare_match *a, const compare_match *b)
+{
+  if (a->a != b->a)
+    {
+      return a->a < b->a ? -1 : 1;
+    }
+
+  if (a->b != b->b)
+    {
+      return a->b < b->b ? -1 : 1;
+    }
+
+  return 0;
+}
+
+/* convert 0-9 distance to same peak count
+ * num1, first peak count
+ * num2, second peak count
+ */
+static int
+distance_to_same_peak_count (gulong num1, gulong num2, int distance)
+{
+  int minnum, count;
+  int rate[] = { 100, 90, 80, 50, 20, 10, 5, 2, 1, 0 };
+
+  minnum = num1 < num2 ? (int)num1 : (int)num2;
+  count = minnum * rate[distance] / 100;
+
+  if (count == 0)
+    count = 1;
+
+  return count;
+}
+
+/* judge two video signatures of count frames, b of blen seconds:
+ * the start of one may be cut, so every alignment shifted by up to a
+ * quarter of the frames is tried and the best one wins */
+gboolean
+compare_video_frames (const hash_t *a, const hash_t *b, int count,
+                      float blen, compare_match *match)
+{
+  int shift, best, most, i, j, overlap, same, dist, sum, total;
+  hash_t mask;
+
+  mask = hash_compare_mask (g_ini->compare_area);
+  best = 0;
+  most = 0;
+  total = 0;
+  for (shift = -count / 4; shift <= count / 4; ++shift)
+    {
+      overlap = 0;
+      same = 0;
+      sum = 0;
+      for (i = MAX (0, -shift); i < count && i + shift < count; ++i)
+        {
+          j = i + shift;
+          if (!a[i] || !b[j])
+            {
+              continue;
+            }
+
+          ++overlap;
+          dist = hash_distance (a[i], b[j], mask);
+          if (dist < g_ini->same_video_distance)
+            {
+              ++same;
+              sum += dist;
+            }
+        }
+
+      /* half of the frames compared, three quarters of them the same */
+      if (overlap * 2 >= count && same * 4 >= overlap * 3 && same > most)
+        {
+          most = same;
+          best = shift;
+          total = sum;
+        }
+    }
+
+  if (most == 0)
+    {
+      return FALSE;
+    }
+
+  /* frame i of a is frame i + best of b, the mean distance of the
+   * frames that are the same */
+  match->type = FD_SAME_VIDEO_FRAMES;
+  match->offset = best * blen / (count + 1);
+  match->orient = 0;
+  match->distance = (total + most / 2) / most;
+
+  return TRUE;
+}
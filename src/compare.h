@@ -0,0 +1,81 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE compare.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_COMPARE_H_
+#define _FDUPVES_COMPARE_H_
+
+#include "audio_index.h"
+#include "find.h"
+#include "hash.h"
+
+#include <glib.h>
+
+/* files per task for hash lookups */
+#ifndef FD_COMPARE_BLOCK
+#define FD_COMPARE_BLOCK 256
+#endif
+
+/* files per task for fingerprint lookups */
+#ifndef FD_COMPARE_AUDIO_BLOCK
+#define FD_COMPARE_AUDIO_BLOCK 64
+#endif
+
+typedef struct
+{
+  guint a;
+  guint b;
+  same_type type;
+  float offset;
+  int distance;
+
+  /* images: the FDUPVES_ORIENTS orient of b that matched a */
+  int orient;
+} compare_match;
+
+/* every task appends its compare_match to out, out is owned by the
+ * worker thread */
+typedef void (*compare_task_func) (gsize, gpointer, GArray *out);
+
+GArray *compare_tasks (gsize, compare_task_func, gpointer, GCancellable *,
+                       find_step *, find_step_cb, gpointer);
+
+int compare_report (GArray *, const gchar **, find_step *, find_step_cb,
+                    gpointer);
+
+/* how byte identical files of a media type, FD_IMAGE .. FD_EBOOK, are
+ * reported */
+same_type compare_exact_type (int);
+
+/* the longest length filter_time_rate still compares with length */
+float compare_length_max (float);
+
+gboolean compare_audio (audio_index_t *, guint, guint, guint, float, float,
+                        compare_match *);
+
+gboolean compare_video_frames (const hash_t *, const hash_t *, int, float,
+                               compare_match *);
+
+#endif
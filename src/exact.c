@@ -0,0 +1,379 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE exact.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "exact.h"
+#include "cache.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* bytes digested at each end of the file */
+#ifndef FD_EXACT_BLOCK
+#define FD_EXACT_BLOCK 4096
+#endif
+
+/* bytes read at once for the whole content */
+#ifndef FD_EXACT_CHUNK
+#define FD_EXACT_CHUNK (64 * 1024)
+#endif
+
+struct exact_file_s
+{
+  gchar *path;
+  gint64 size;
+
+  /* 0 when the file can not be read */
+  hash_t head;
+  hash_t full;
+  gboolean has_head;
+  gboolean has_full;
+
+  /* earlier file with the same content */
+  exact_file *same;
+
+  gboolean done;
+  gpointer payload;
+};
+
+struct exact_s
+{
+  /* guards the digests, done and payload of every file */
+  GMutex lock;
+  GCond cond;
+
+  /* size -> GPtrArray of exact_file, in the order they were added */
+  GHashTable *sizes;
+  GPtrArray *files;
+  GDestroyNotify payload_free;
+};
+
+static hash_t exact_digest (exact_t *, exact_file *, gboolean);
+
+static hash_t exact_digest_ends (const gchar *, gint64);
+
+static hash_t exact_digest_all (const gchar *);
+
+static hash_t exact_checksum_hash (GChecksum *);
+
+static void exact_file_free (exact_file *, exact_t *);
+
+exact_t *
+exact_new (GDestroyNotify payload_free)
+{
+  exact_t *exact;
+
+  exact = g_new0 (exact_t, 1);
+  g_return_val_if_fail (exact, NULL);
+
+  g_mutex_init (&exact->lock);
+  g_cond_init (&exact->cond);
+  exact->sizes = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL,
+                                        (GDestroyNotify)g_ptr_array_unref);
+  exact->files = g_ptr_array_new ();
+  exact->payload_free = payload_free;
+
+  return exact;
+}
+
+void
+exact_free (exact_t *exact)
+{
+  g_hash_table_destroy (exact->sizes);
+  g_ptr_array_foreach (exact->files, (GFunc)exact_file_free, exact);
+  g_ptr_array_free (exact->files, TRUE);
+  g_mutex_clear (&exact->lock);
+  g_cond_clear (&exact->cond);
+  g_free (exact);
+}
+
+exact_file *
+exact_add (exact_t *exact, const gchar *path, exact_file **same)
+{
+  exact_file *file, *other;
+  GPtrArray *bucket, *earlier;
+  GStatBuf buf[1];
+  hash_t digest;
+  guint i;
+
+  *same = NULL;
+  if (g_stat (path, buf) != 0)
+    {
+      return NULL;
+    }
+
+  file = g_new0 (exact_file, 1);
+  file->path = g_strdup (path);
+  file->size = (gint64)buf->st_size;
+
+  g_mutex_lock (&exact->lock);
+  g_ptr_array_add (exact->files, file);
+  bucket = g_hash_table_lookup (exact->sizes, &file->size);
+  if (bucket == NULL)
+    {
+      bucket = g_ptr_array_new ();
+      g_hash_table_insert (exact->sizes, &file->size, bucket);
+    }
+
+  /* most sizes are unique, nothing is read then */
+  earlier = NULL;
+  if (bucket->len > 0)
+    {
+      earlier = g_ptr_array_sized_new (bucket->len);
+      for (i = 0; i < bucket->len; ++i)
+        {
+          g_ptr_array_add (earlier, g_ptr_array_index (bucket, i));
+        }
+    }
+  g_ptr_array_add (bucket, file);
+  g_mutex_unlock (&exact->lock);
+
+  if (earlier == NULL)
+    {
+      return file;
+    }
+
+  for (i = 0; i < earlier->len && *same == NULL; ++i)
+    {
+      other = g_ptr_array_index (earlier, i);
+
+      digest = exact_digest (exact, file, FALSE);
+      if (digest == 0 || exact_digest (exact, other, FALSE) != digest)
+        {
+          continue;
+        }
+
+      digest = exact_digest (exact, file, TRUE);
+      if (digest == 0 || exact_digest (exact, other, TRUE) != digest)
+        {
+          continue;
+        }
+
+      *same = other;
+    }
+  g_ptr_array_free (earlier, TRUE);
+
+  g_mutex_lock (&exact->lock);
+  file->same = *same;
+  g_mutex_unlock (&exact->lock);
+
+  return file;
+}
+
+void
+exact_publish (exact_t *exact, exact_file *file, gpointer payload)
+{
+  g_mutex_lock (&exact->lock);
+  file->payload = payload;
+  file->done = TRUE;
+  g_cond_broadcast (&exact->cond);
+  g_mutex_unlock (&exact->lock);
+}
+
+/* a file only waits for earlier ones, so the waits can not loop */
+exact_file *
+exact_wait (exact_t *exact, exact_file *file)
+{
+  g_mutex_lock (&exact->lock);
+  for (;;)
+    {
+      while (!file->done)
+        {
+          g_cond_wait (&exact->cond, &exact->lock);
+        }
+
+      if (file->same == NULL)
+        {
+          break;
+        }
+      file = file->same;
+    }
+  g_mutex_unlock (&exact->lock);
+
+  return file;
+}
+
+const gchar *
+exact_path (exact_file *file)
+{
+  return file->path;
+}
+
+gpointer
+exact_payload (exact_file *file)
+{
+  return file->payload;
+}
+
+/* computed once, out of the lock, by whichever thread needs it first */
+static hash_t
+exact_digest (exact_t *exact, exact_file *file, gboolean full)
+{
+  hash_t digest;
+  gboolean has;
+
+  g_mutex_lock (&exact->lock);
+  has = full ? file->has_full : file->has_head;
+  digest = full ? file->full : file->head;
+  g_mutex_unlock (&exact->lock);
+
+  if (has)
+    {
+      return digest;
+    }
+
+  digest = full ? exact_digest_all (file->path)
+                : exact_digest_ends (file->path, file->size);
+
+  g_mutex_lock (&exact->lock);
+  if (full)
+    {
+      file->full = digest;
+      file->has_full = TRUE;
+    }
+  else
+    {
+      file->head = digest;
+      file->has_head = TRUE;
+    }
+  g_mutex_unlock (&exact->lock);
+
+  return digest;
+}
+
+static hash_t
+exact_digest_ends (const gchar *path, gint64 size)
+{
+  FILE *fp;
+  GChecksum *checksum;
+  guchar buf[FD_EXACT_BLOCK];
+  size_t n;
+  hash_t digest;
+
+  fp = g_fopen (path, "rb");
+  if (fp == NULL)
+    {
+      return 0;
+    }
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  n = fread (buf, 1, sizeof buf, fp);
+  g_checksum_update (checksum, buf, n);
+
+  /* the last block, without reading the first one again */
+  if (size > FD_EXACT_BLOCK
+      && fseek (fp, -(long)MIN (size - FD_EXACT_BLOCK, FD_EXACT_BLOCK),
+                SEEK_END)
+             == 0)
+    {
+      n = fread (buf, 1, sizeof buf, fp);
+      g_checksum_update (checksum, buf, n);
+    }
+
+  digest = ferror (fp) ? 0 : exact_checksum_hash (checksum);
+
+  g_checksum_free (checksum);
+  fclose (fp);
+
+  return digest;
+}
+
+static hash_t
+exact_digest_all (const gchar *path)
+{
+  FILE *fp;
+  GChecksum *checksum;
+  GCancellable *cancel;
+  guchar *buf;
+  size_t n;
+  hash_t digest;
+
+  if (g_cache && cache_get (g_cache, path, 0, FDUPVES_FILE_DIGEST, &digest))
+    {
+      return digest;
+    }
+
+  fp = g_fopen (path, "rb");
+  if (fp == NULL)
+    {
+      return 0;
+    }
+
+  cancel = g_cancellable_get_current ();
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  buf = g_malloc (FD_EXACT_CHUNK);
+  while (!g_cancellable_is_cancelled (cancel)
+         && (n = fread (buf, 1, FD_EXACT_CHUNK, fp)) > 0)
+    {
+      g_checksum_update (checksum, buf, n);
+    }
+
+  digest = 0;
+  if (!ferror (fp) && !g_cancellable_is_cancelled (cancel))
+    {
+      digest = exact_checksum_hash (checksum);
+    }
+
+  g_free (buf);
+  g_checksum_free (checksum);
+  fclose (fp);
+
+  if (g_cache && digest)
+    {
+      cache_set (g_cache, path, 0, FDUPVES_FILE_DIGEST, digest);
+    }
+
+  return digest;
+}
+
+/* the first 64 bits, never 0 */
+static hash_t
+exact_checksum_hash (GChecksum *checksum)
+{
+  guint8 bytes[16];
+  gsize len;
+  hash_t digest;
+
+  len = sizeof bytes;
+  g_checksum_get_digest (checksum, bytes, &len);
+  memcpy (&digest, bytes, sizeof digest);
+
+  return digest ? digest : 1;
+}
+
+static void
+exact_file_free (exact_file *file, exact_t *exact)
+{
+  if (file->payload && exact->payload_free)
+    {
+      exact->payload_free (file->payload);
+    }
+  g_free (file->path);
+  g_free (file);
+}
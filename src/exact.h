@@ -0,0 +1,65 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE exact.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_EXACT_H_
+#define _FDUPVES_EXACT_H_
+
+#include "hash.h"
+
+#include <glib.h>
+
+/* cache alg of the whole content digest */
+#define FDUPVES_FILE_DIGEST 0xFFFE
+
+/* byte identical files:
+ * a file is compared to the earlier ones of the same size, first by a
+ * digest of its first and last blocks, then by a digest of the whole
+ * content. the first file of an identical set is its representative,
+ * the others wait for what it publishes instead of decoding themselves.
+ */
+typedef struct exact_s exact_t;
+
+typedef struct exact_file_s exact_file;
+
+exact_t *exact_new (GDestroyNotify);
+
+void exact_free (exact_t *);
+
+/* registers the file, *same is the earlier file with the same content or
+ * NULL. returns NULL when the file can not be read */
+exact_file *exact_add (exact_t *, const gchar *, exact_file **same);
+
+/* the payload of the file, NULL when it has none, wakes its copies */
+void exact_publish (exact_t *, exact_file *, gpointer);
+
+/* blocks until the representative of file has published */
+exact_file *exact_wait (exact_t *, exact_file *);
+
+const gchar *exact_path (exact_file *);
+
+gpointer exact_payload (exact_file *);
+
+#endif
@@ -26,33 +26,81 @@
 
 #include "find.h"
 #include "audio.h"
+#include "compare.h"
 #include "ebook.h"
-#include "gui.h"
+#include "exact.h"
 #include "hash.h"
 #include "ini.h"
+#include "match.h"
 #include "util.h"
 #include "video.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #ifndef FD_COMP_CNT
 #define FD_COMP_CNT 2
 #endif
 
-struct st_hash
+struct st_file
 {
-  int seek;
-  hash_t hash;
+  const char *path;
+
+  /* video: the timer groups covering the length */
+  guint groups;
+
+  match_file file;
 };
 
-struct st_file
+/* a file of ptr, by its length */
+struct st_order
 {
-  const char *path;
   float length;
-  float offset;
-  struct st_hash head[1];
-  struct st_hash tail[1];
-  hash_array_t *hashArray;
+  guint index;
+};
+
+/* the files of a domain, queried block by block */
+struct st_match
+{
+  match_domain_t *domain;
+  gsize n;
+  gsize block;
+
+  /* the representative of every id, its copies are already reported */
+  const guint *reps;
+
+  /* the image candidates to sign */
+  guint *ids;
+};
+
+typedef void (*st_work_func) (gsize, gpointer);
+
+struct st_work
+{
+  st_work_func func;
+  gpointer data;
+  GCancellable *cancel;
+  gsize done;
+  GMutex lock;
+  GCond cond;
+};
+
+struct st_hashs
+{
+  GPtrArray *ptr;
+  hash_t *hashs;
+  ebook_hash_t *ebooks;
+
+  /* the representative of every file, see find_exact */
+  guint *reps;
+};
+
+struct st_exact
+{
+  GPtrArray *ptr;
+  exact_t *exact;
+  exact_file **files;
+  exact_file **sames;
 };
 
 struct st_find
@@ -62,89 +110,152 @@ struct st_find
   find_step *step;
   find_step_cb cb;
   GThreadPool *thread_pool;
+  GCancellable *cancel;
   gpointer arg;
 };
 
-static void find_video_prepare (const gchar *file, struct st_find *find);
+static struct st_file *find_video_prepare (const gchar *file,
+                                           struct st_find *find);
 
-static void find_audio_prepare (const gchar *file, struct st_find *find);
+static struct st_file *find_audio_prepare (const gchar *file,
+                                           struct st_find *find);
 
-static int video_hash_func (struct st_file *file);
+static void video_hash_func (struct st_file *file, struct st_find *);
 
-static int audio_hashes_func (struct st_file *file);
+static void audio_hashes_func (struct st_file *file, struct st_find *);
 
 static void st_file_free (struct st_file *);
 
+static void find_parallel (gsize, st_work_func, gpointer, GCancellable *,
+                           find_step *, find_step_cb, gpointer);
+
+static guint *find_add_files (match_domain_t *, GPtrArray *, const guint *,
+                              struct st_file **);
+
+static gint st_order_cmp (const struct st_order *,
+                          const struct st_order *);
+
+static guint *find_exact (GPtrArray *, GCancellable *, find_step *,
+                          find_step_cb, gpointer);
+
+static int find_copies (GPtrArray *, const guint *, int, find_step *,
+                        find_step_cb, gpointer);
+
+static void exact_add_func (gsize, struct st_exact *);
+
+static void image_hash_func (gsize, struct st_hashs *);
+
+static void ebook_hash_func (gsize, struct st_hashs *);
+
+static int find_matches (match_domain_t *, const guint *, gsize,
+                         GCancellable *, find_step *, find_step_cb,
+                         gpointer);
+
+static void find_match_task (gsize, struct st_match *, GArray *);
+
+static gboolean find_same_rep (guint, guint, struct st_match *);
+
+static gboolean image_verify (match_domain_t *, GArray *, GCancellable *,
+                              find_step *, find_step_cb, gpointer);
+
+static void image_sign_func (gsize, struct st_match *);
+
+static const gchar *find_type_names[] = {
+  "image", "video_head", "video_tail", "audio_head",
+  "audio_tail", "ebook", "video_frames",
+};
+
+const gchar *
+find_type_name (same_type type)
+{
+  g_return_val_if_fail (type < G_N_ELEMENTS (find_type_names), "unknown");
+
+  return find_type_names[type];
+}
+
 int
-find_images (GPtrArray *ptr, find_step_cb cb, gpointer arg)
+find_images (GPtrArray *ptr, GCancellable *cancel, find_step_cb cb,
+             gpointer arg)
 {
-  size_t i, j;
-  int dist, count;
+  size_t i;
+  int count;
   hash_t *hashs;
+  guint *reps;
+  match_domain_t *domain;
+  match_file file[1];
+  struct st_hashs job[1];
   find_step step[1];
 
-  count = 0;
+  step->found = FALSE;
+  step->removed = FALSE;
+  step->distance = -1;
+  reps = find_exact (ptr, cancel, step, cb, arg);
+  if (reps == NULL)
+    {
+      return 0;
+    }
+  count = find_copies (ptr, reps, FD_IMAGE, step, cb, arg);
 
   hashs = g_new0 (hash_t, ptr->len);
-  g_return_val_if_fail (hashs, 0);
-
-  step->found = FALSE;
   step->total = ptr->len;
   step->doing = _ ("Generate image hash value");
-  for (i = 0; i < ptr->len; ++i)
+  job->ptr = ptr;
+  job->hashs = hashs;
+  job->reps = reps;
+  find_parallel (ptr->len, (st_work_func)image_hash_func, job, cancel, step,
+                 cb, arg);
+  if (g_cancellable_is_cancelled (cancel))
     {
-      hashs[i] = image_file_hash ((gchar *)g_ptr_array_index (ptr, i));
-      step->now = i;
-      cb (step, arg);
+      g_free (reps);
+      g_free (hashs);
+      return count;
     }
 
-  step->doing = _ ("Compare image hash value");
-  step->now = 0;
-  for (i = 0; i < ptr->len - 1; ++i)
+  /* every file is added, the ids are the indexes of ptr */
+  domain = match_domain_new (FD_IMAGE, ptr->len);
+  memset (file, 0, sizeof file);
+  for (i = 0; i < ptr->len; ++i)
     {
-      for (j = i + 1; j < ptr->len; ++j)
-        {
-          dist = hash_cmp (hashs[i], hashs[j]);
-          if (dist < g_ini->same_image_distance)
-            {
-              step->afile = g_ptr_array_index (ptr, i);
-              step->bfile = g_ptr_array_index (ptr, j);
-              step->found = TRUE;
-              step->type = FD_SAME_IMAGE;
-              cb (step, arg);
-              ++count;
-            }
-        }
-
-      step->now = i;
-      step->found = FALSE;
-      cb (step, arg);
+      file->heads[0] = hashs[reps[i]];
+      match_domain_add (domain, g_ptr_array_index (ptr, i), file);
     }
-
   g_free (hashs);
 
+  step->doing = _ ("Compare image hash value");
+  count += find_matches (domain, reps, FD_COMPARE_BLOCK, cancel, step, cb,
+                         arg);
+  match_domain_free (domain);
+  g_free (reps);
+
   return count;
 }
 
 int
-find_videos (GPtrArray *ptr, find_step_cb cb, gpointer arg)
+find_videos (GPtrArray *ptr, GCancellable *cancel, find_step_cb cb,
+             gpointer arg)
 {
-  gsize i, j, g, group_cnt;
-  int dist, count;
+  gsize i;
+  int count;
+  guint *reps, *ids;
+  match_domain_t *domain;
   struct st_find find[1];
-  struct st_file *afile, *bfile;
+  struct st_file **files;
   find_step step[1];
-  gui_t *gui = (gui_t *)arg;
-
-  count = 0;
 
-  for (i = 0; g_ini->video_timers[i][0]; ++i)
+  step->found = FALSE;
+  step->removed = FALSE;
+  step->distance = -1;
+  reps = find_exact (ptr, cancel, step, cb, arg);
+  if (reps == NULL)
     {
-      find->ptr[i] = g_ptr_array_new_with_free_func ((GFreeFunc)st_file_free);
+      return 0;
     }
-  group_cnt = i;
+  count = find_copies (ptr, reps, FD_VIDEO, step, cb, arg);
+
+  /* one record per content, whatever groups cover it */
+  find->ptr[0] = g_ptr_array_new_with_free_func ((GFreeFunc)st_file_free);
+  files = g_new0 (struct st_file *, ptr->len);
 
-  step->found = FALSE;
   step->total = ptr->len;
   step->now = 0;
   step->doing = _ ("Generate video screenshot hash value");
@@ -152,320 +263,279 @@ find_videos (GPtrArray *ptr, find_step_cb cb, gpointer arg)
   find->step = step;
   find->type = FD_VIDEO;
   find->cb = cb;
+  find->cancel = cancel;
   find->arg = arg;
-  g_ptr_array_foreach (ptr, (GFunc)find_video_prepare, find);
-
-  step->doing = _ ("Compare video screenshot hash value");
-  for (g = 0; g < group_cnt; ++g)
+  for (i = 0; i < ptr->len; ++i)
     {
-      if (find->ptr[g]->len <= 0)
+      if (reps[i] == i)
         {
-          g_ptr_array_free (find->ptr[g], TRUE);
+          files[i] = find_video_prepare (g_ptr_array_index (ptr, i), find);
           continue;
         }
 
-      find->thread_pool = g_thread_pool_new (
-          (GFunc)video_hash_func, find, g_ini->threads_count, FALSE, NULL);
-      if (find->thread_pool == NULL)
-        {
-          g_ptr_array_free (find->ptr[g], TRUE);
-          continue;
-        }
-
-      for (i = 0; i < find->ptr[g]->len; ++i)
-        {
-          afile = g_ptr_array_index (find->ptr[g], i);
-          afile->offset = g_ini->video_timers[g][2];
-          g_thread_pool_push (find->thread_pool, afile, NULL);
-        }
-
-      g_thread_pool_free (find->thread_pool, FALSE, TRUE);
-
-      if (gui->quit)
-        return 0;
-
-      for (i = 0; i < find->ptr[g]->len - 1; ++i)
-        {
-          for (j = i + 1; j < find->ptr[g]->len; ++j)
-            {
-              afile = g_ptr_array_index (find->ptr[g], i);
-              bfile = g_ptr_array_index (find->ptr[g], j);
-
-              dist = hash_cmp (afile->head->hash, bfile->head->hash);
-              if (dist < g_ini->same_video_distance)
-                {
-                  step->found = TRUE;
-                  step->afile = afile->path;
-                  step->bfile = bfile->path;
-                  step->type = FD_SAME_VIDEO_HEAD;
-                  cb (step, arg);
-                  ++count;
-                  continue;
-                }
-
-              dist = hash_cmp (afile->tail->hash, bfile->tail->hash);
-              if (dist < g_ini->same_video_distance)
-                {
-                  step->found = TRUE;
-                  step->afile = afile->path;
-                  step->bfile = bfile->path;
-                  step->type = FD_SAME_VIDEO_TAIL;
-                  cb (step, arg);
-                  ++count;
-                }
-            }
+      ++step->now;
+      cb (step, arg);
+    }
 
-          step->found = FALSE;
-          step->total = find->ptr[g]->len;
-          step->now = i;
-          cb (step, arg);
-        }
+  find->thread_pool = g_thread_pool_new ((GFunc)video_hash_func, find,
+                                         g_ini->threads_count, FALSE, NULL);
+  if (find->thread_pool == NULL)
+    {
+      g_ptr_array_free (find->ptr[0], TRUE);
+      g_free (files);
+      g_free (reps);
+      return -1;
+    }
 
-      g_ptr_array_free (find->ptr[g], TRUE);
+  for (i = 0; i < find->ptr[0]->len; ++i)
+    {
+      g_thread_pool_push (find->thread_pool,
+                          g_ptr_array_index (find->ptr[0], i), NULL);
     }
 
-  return count;
-}
+  g_thread_pool_free (find->thread_pool, FALSE, TRUE);
 
-/* convert 0-9 distance to same peak count
- * num1, first peak count
- * num2, second peak count
- */
-static int
-distance_to_same_peak_count (gulong num1, gulong num2, int distance)
-{
-  int minnum, count;
-  int rate[] = { 100, 90, 80, 50, 20, 10, 5, 2, 1, 0 };
+  /* the queued files returned at once */
+  if (g_cancellable_is_cancelled (cancel))
+    {
+      g_ptr_array_free (find->ptr[0], TRUE);
+      g_free (files);
+      g_free (reps);
+      return count;
+    }
 
-  minnum = num1 < num2 ? (int)num1 : (int)num2;
-  count = minnum * rate[distance] / 100;
+  domain = match_domain_new (FD_VIDEO, ptr->len);
+  ids = find_add_files (domain, ptr, reps, files);
+  g_ptr_array_free (find->ptr[0], TRUE);
+  g_free (files);
+  g_free (reps);
 
-  if (count == 0)
-    count = 1;
+  step->doing = _ ("Compare video screenshot hash value");
+  count += find_matches (domain, ids,
+                         g_ini->video_frames > 0 ? FD_COMPARE_AUDIO_BLOCK
+                                                 : FD_COMPARE_BLOCK,
+                         cancel, step, cb, arg);
+  match_domain_free (domain);
+  g_free (ids);
 
   return count;
 }
 
 int
-find_audios (GPtrArray *ptr, find_step_cb cb, gpointer arg)
+find_audios (GPtrArray *ptr, GCancellable *cancel, find_step_cb cb,
+             gpointer arg)
 {
-  gsize i, j, dist;
-  int count, peak_count;
-  float blen, llen;
+  gsize i;
+  int count;
+  guint *reps, *ids;
+  match_domain_t *domain;
   struct st_find find[1];
-  struct st_file *afile, *bfile;
+  struct st_file **files;
   find_step step[1];
-  gui_t *gui = (gui_t *)arg;
-  static int rates[] = { 0, 1, 2, 10, 20, 100 };
 
-  count = 0;
-  find->ptr[0] = g_ptr_array_new_with_free_func ((GFreeFunc)st_file_free);
   step->found = FALSE;
+  step->removed = FALSE;
+  step->distance = -1;
+  reps = find_exact (ptr, cancel, step, cb, arg);
+  if (reps == NULL)
+    {
+      return 0;
+    }
+  count = find_copies (ptr, reps, FD_AUDIO, step, cb, arg);
+
+  find->ptr[0] = g_ptr_array_new_with_free_func ((GFreeFunc)st_file_free);
+  files = g_new0 (struct st_file *, ptr->len);
   step->total = ptr->len;
   step->now = 0;
   step->doing = _ ("Generate audio screenshot hash value");
 
-  find->thread_pool = g_thread_pool_new ((GFunc)audio_hashes_func, NULL,
+  find->thread_pool = g_thread_pool_new ((GFunc)audio_hashes_func, find,
                                          g_ini->threads_count, FALSE, NULL);
   if (find->thread_pool == NULL)
     {
       g_ptr_array_free (find->ptr[0], TRUE);
+      g_free (files);
+      g_free (reps);
       return -1;
     }
 
   find->step = step;
   find->type = FIND_AUDIO;
   find->cb = cb;
+  find->cancel = cancel;
   find->arg = arg;
-  g_ptr_array_foreach (ptr, (GFunc)find_audio_prepare, find);
-
-  g_thread_pool_free (find->thread_pool, FALSE, TRUE);
-
-  if (gui->quit)
-    return 0;
-
-  step->doing = _ ("Compare audio hash value");
-  for (i = 0; i < find->ptr[0]->len - 1; ++i)
+  for (i = 0; i < ptr->len; ++i)
     {
-      afile = g_ptr_array_index (find->ptr[0], i);
-
-      if (hash_array_size (afile->hashArray) == 0)
+      if (reps[i] == i)
         {
+          files[i] = find_audio_prepare (g_ptr_array_index (ptr, i), find);
           continue;
         }
 
-      for (j = i + 1; j < find->ptr[0]->len; ++j)
-        {
-          bfile = g_ptr_array_index (find->ptr[0], j);
-
-          if (hash_array_size (bfile->hashArray) == 0)
-            {
-              continue;
-            }
-
-          if (g_ini->filter_time_rate != 0)
-            {
-              blen = afile->length;
-              llen = bfile->length;
-              if (blen < llen)
-                {
-                  llen = afile->length;
-                  blen = bfile->length;
-                }
-              if (llen * (float)(rates[g_ini->filter_time_rate] + 1) < blen)
-                {
-                  g_debug ("%s length %f and %s lenght %f, filtered",
-                           afile->path, afile->length, bfile->path,
-                           bfile->length);
-                  continue;
-                }
-            }
+      ++step->now;
+      cb (step, arg);
+    }
 
-          dist = audio_fingerprint_similarity (afile->hashArray,
-                                               bfile->hashArray);
-          if (dist == 0)
-            continue;
-
-          peak_count = distance_to_same_peak_count (
-              hash_array_size (afile->hashArray),
-              hash_array_size (bfile->hashArray), g_ini->same_audio_distance);
-          g_debug ("distance: %d, peaks %lu and %lu, need %d, dist: %lu",
-                   g_ini->same_audio_distance,
-                   hash_array_size (afile->hashArray),
-                   hash_array_size (bfile->hashArray), peak_count, dist);
-          if (dist >= peak_count)
-            {
-              step->found = TRUE;
-              step->afile = afile->path;
-              step->bfile = bfile->path;
-              step->type = FD_SAME_AUDIO_HEAD;
-              cb (step, arg);
-              ++count;
-              continue;
-            }
-        }
+  g_thread_pool_free (find->thread_pool, FALSE, TRUE);
 
-      step->found = FALSE;
-      step->total = find->ptr[0]->len;
-      step->now = i;
-      cb (step, arg);
+  if (g_cancellable_is_cancelled (cancel))
+    {
+      g_ptr_array_free (find->ptr[0], TRUE);
+      g_free (files);
+      g_free (reps);
+      return count;
     }
 
+  /* candidates only come from shared peak hashes */
+  domain = match_domain_new (FD_AUDIO, ptr->len);
+  ids = find_add_files (domain, ptr, reps, files);
   g_ptr_array_free (find->ptr[0], TRUE);
+  g_free (files);
+  g_free (reps);
+
+  step->doing = _ ("Compare audio hash value");
+  count += find_matches (domain, ids, FD_COMPARE_AUDIO_BLOCK, cancel, step,
+                         cb, arg);
+  match_domain_free (domain);
+  g_free (ids);
 
   return count;
 }
 
 int
-find_ebooks (GPtrArray *ptr, find_step_cb cb, gpointer arg)
+find_ebooks (GPtrArray *ptr, GCancellable *cancel, find_step_cb cb,
+             gpointer arg)
 {
-  guint i, j;
-  int dist, count;
+  guint i;
+  int count;
   ebook_hash_t *hashs;
+  guint *reps;
+  match_domain_t *domain;
+  match_file file[1];
+  struct st_hashs job[1];
   find_step step[1];
 
-  count = 0;
+  step->found = FALSE;
+  step->removed = FALSE;
+  step->distance = -1;
+  reps = find_exact (ptr, cancel, step, cb, arg);
+  if (reps == NULL)
+    {
+      return 0;
+    }
+  count = find_copies (ptr, reps, FD_EBOOK, step, cb, arg);
 
   hashs = g_new0 (ebook_hash_t, ptr->len);
-  g_return_val_if_fail (hashs, 0);
-
-  step->found = FALSE;
   step->total = ptr->len;
   step->doing = _ ("Generate ebook hash value");
-  for (i = 0; i < ptr->len; ++i)
+  job->ptr = ptr;
+  job->ebooks = hashs;
+  job->reps = reps;
+  find_parallel (ptr->len, (st_work_func)ebook_hash_func, job, cancel, step,
+                 cb, arg);
+  if (g_cancellable_is_cancelled (cancel))
     {
-      ebook_file_hash ((gchar *)g_ptr_array_index (ptr, i), hashs + i);
-      step->now = i;
-      cb (step, arg);
+      g_free (reps);
+      g_free (hashs);
+      return count;
     }
 
-  step->doing = _ ("Compare ebook hash value");
-  step->now = 0;
-  for (i = 0; i < ptr->len - 1; ++i)
+  /* ebook_hash_cmp only ever matches on the cover hashes */
+  domain = match_domain_new (FD_EBOOK, ptr->len);
+  memset (file, 0, sizeof file);
+  for (i = 0; i < ptr->len; ++i)
     {
-      for (j = i + 1; j < ptr->len; ++j)
-        {
-          dist = ebook_hash_cmp (hashs + i, hashs + j);
-          if (dist < g_ini->same_image_distance)
-            {
-              step->afile = g_ptr_array_index (ptr, i);
-              step->bfile = g_ptr_array_index (ptr, j);
-              step->found = TRUE;
-              step->type = FD_SAME_EBOOK;
-              cb (step, arg);
-              ++count;
-            }
-        }
-
-      step->now = i;
-      step->found = FALSE;
-      cb (step, arg);
+      file->heads[0] = hashs[reps[i]].cover_hash;
+      match_domain_add (domain, g_ptr_array_index (ptr, i), file);
     }
-
   g_free (hashs);
 
+  step->doing = _ ("Compare ebook hash value");
+  count += find_matches (domain, reps, FD_COMPARE_BLOCK, cancel, step, cb,
+                         arg);
+  match_domain_free (domain);
+  g_free (reps);
+
   return count;
 }
 
 static void
 st_file_free (struct st_file *file)
 {
-  if (file->hashArray)
-    hash_array_free (file->hashArray);
+  if (file->file.peaks)
+    hash_array_free (file->file.peaks);
+  g_free (file->file.frames);
   g_free (file);
 }
 
-static void
+static struct st_file *
 find_video_prepare (const gchar *file, struct st_find *find)
 {
   int i, length;
   struct st_file *stv;
 
+  if (g_cancellable_is_cancelled (find->cancel))
+    {
+      return NULL;
+    }
+
   length = video_get_length (file);
   if (length <= 0)
     {
       g_warning ("Can't get duration of %s", file);
-      return;
+      return NULL;
     }
 
+  stv = g_malloc0 (sizeof (struct st_file));
+  stv->path = file;
+  stv->file.length = length;
   for (i = 0; g_ini->video_timers[i][0]; ++i)
     {
-      if (length < g_ini->video_timers[i][0]
-          || length > g_ini->video_timers[i][1])
+      if (length >= g_ini->video_timers[i][0]
+          && length <= g_ini->video_timers[i][1])
         {
-          continue;
+          stv->groups |= 1u << i;
         }
+    }
 
-      stv = g_malloc0 (sizeof (struct st_file));
-
-      stv->path = file;
-      stv->length = length;
-
-      g_ptr_array_add (find->ptr[i], stv);
+  if (stv->groups || g_ini->video_frames > 0)
+    {
+      g_ptr_array_add (find->ptr[0], stv);
+    }
+  else
+    {
+      g_free (stv);
+      stv = NULL;
     }
 
   ++find->step->now;
   find->cb (find->step, find->arg);
+
+  return stv;
 }
 
-static void
+static struct st_file *
 find_audio_prepare (const gchar *file, struct st_find *find)
 {
   float length;
   struct st_file *stv;
 
+  if (g_cancellable_is_cancelled (find->cancel))
+    {
+      return NULL;
+    }
+
   length = audio_get_length (file);
   if (length <= 0.1f)
     {
       g_warning ("Can't get duration of %s", file);
-      return;
+      return NULL;
     }
 
   stv = g_malloc0 (sizeof (struct st_file));
 
   stv->path = file;
-  stv->length = length;
-  stv->hashArray = NULL;
+  stv->file.length = length;
 
   g_thread_pool_push (find->thread_pool, stv, NULL);
 
@@ -473,19 +543,432 @@ find_audio_prepare (const gchar *file, struct st_find *find)
 
   ++find->step->now;
   find->cb (find->step, find->arg);
+
+  return stv;
+}
+
+/* a copy is added with the hashes of its representative, the domain
+ * keeps a copy of them; the files go by ascending length so a query only
+ * meets the lengths it compares with. returns the representative of
+ * every id */
+static guint *
+find_add_files (match_domain_t *domain, GPtrArray *ptr, const guint *reps,
+                struct st_file **files)
+{
+  struct st_order *order;
+  guint i, n, *ids;
+
+  order = g_new (struct st_order, ptr->len);
+  for (i = 0, n = 0; i < ptr->len; ++i)
+    {
+      if (files[reps[i]])
+        {
+          order[n].length = files[reps[i]]->file.length;
+          order[n].index = i;
+          ++n;
+        }
+    }
+  qsort (order, n, sizeof (struct st_order),
+         (int (*) (const void *, const void *))st_order_cmp);
+
+  ids = g_new (guint, MAX (n, 1));
+  for (i = 0; i < n; ++i)
+    {
+      ids[match_domain_add (domain, g_ptr_array_index (ptr, order[i].index),
+                            &files[reps[order[i].index]]->file)]
+          = reps[order[i].index];
+    }
+  g_free (order);
+
+  return ids;
+}
+
+static gint
+st_order_cmp (const struct st_order *a, const struct st_order *b)
+{
+  if (a->length != b->length)
+    {
+      return a->length < b->length ? -1 : 1;
+    }
+
+  return (a->index > b->index) - (a->index < b->index);
+}
+
+/* byte identical files are decoded once: the index of the first file with
+ * the content of every file, its own for the first one and for a file
+ * that can not be read; NULL when cancelled */
+static guint *
+find_exact (GPtrArray *ptr, GCancellable *cancel, find_step *step,
+            find_step_cb cb, gpointer arg)
+{
+  struct st_exact job[1];
+  guint i, *reps;
+
+  job->ptr = ptr;
+  job->exact = exact_new (NULL);
+  job->files = g_new0 (exact_file *, ptr->len);
+  job->sames = g_new0 (exact_file *, ptr->len);
+  step->total = ptr->len;
+  step->doing = _ ("Find byte identical files");
+  find_parallel (ptr->len, (st_work_func)exact_add_func, job, cancel, step,
+                 cb, arg);
+
+  reps = NULL;
+  if (!g_cancellable_is_cancelled (cancel))
+    {
+      /* every file is added, nothing waits */
+      for (i = 0; i < ptr->len; ++i)
+        {
+          if (job->files[i])
+            {
+              exact_publish (job->exact, job->files[i],
+                             GUINT_TO_POINTER (i + 1));
+            }
+        }
+
+      reps = g_new (guint, ptr->len);
+      for (i = 0; i < ptr->len; ++i)
+        {
+          reps[i] = i;
+          if (job->sames[i])
+            {
+              reps[i] = GPOINTER_TO_UINT (exact_payload (
+                            exact_wait (job->exact, job->sames[i])))
+                        - 1;
+            }
+        }
+    }
+
+  exact_free (job->exact);
+  g_free (job->files);
+  g_free (job->sames);
+
+  return reps;
 }
 
+/* the copies are reported before anything is decoded, whether their
+ * content decodes or not */
 static int
-video_hash_func (struct st_file *file)
+find_copies (GPtrArray *ptr, const guint *reps, int type, find_step *step,
+             find_step_cb cb, gpointer arg)
+{
+  guint i;
+  int count;
+
+  count = 0;
+  for (i = 0; i < ptr->len; ++i)
+    {
+      if (reps[i] != i)
+        {
+          step->afile = g_ptr_array_index (ptr, reps[i]);
+          step->bfile = g_ptr_array_index (ptr, i);
+          step->found = TRUE;
+          step->type = compare_exact_type (type);
+          step->offset = 0;
+          step->distance = 0;
+          cb (step, arg);
+          ++count;
+        }
+    }
+  step->found = FALSE;
+  step->distance = -1;
+
+  return count;
+}
+
+static void
+exact_add_func (gsize i, struct st_exact *job)
+{
+  job->files[i] = exact_add (job->exact, g_ptr_array_index (job->ptr, i),
+                             job->sames + i);
+}
+
+static void
+find_parallel_func (gpointer item, struct st_work *work)
+{
+  /* the queued items are only counted once cancelled */
+  if (!g_cancellable_is_cancelled (work->cancel))
+    {
+      fd_push_cancel (work->cancel);
+      work->func (GPOINTER_TO_SIZE (item) - 1, work->data);
+      fd_pop_cancel (work->cancel);
+    }
+
+  g_mutex_lock (&work->lock);
+  ++work->done;
+  g_cond_signal (&work->cond);
+  g_mutex_unlock (&work->lock);
+}
+
+/* run func on 0..count-1 in the thread pool,
+ * the progress is reported from the calling thread */
+static void
+find_parallel (gsize count, st_work_func func, gpointer data,
+               GCancellable *cancel, find_step *step, find_step_cb cb,
+               gpointer arg)
+{
+  struct st_work work[1];
+  GThreadPool *pool;
+  gsize i, done;
+
+  work->func = func;
+  work->data = data;
+  work->cancel = cancel;
+  work->done = 0;
+
+  pool = g_thread_pool_new ((GFunc)find_parallel_func, work,
+                            g_ini->threads_count, FALSE, NULL);
+  if (pool == NULL)
+    {
+      for (i = 0; i < count && !g_cancellable_is_cancelled (cancel); ++i)
+        {
+          func (i, data);
+          step->now = i;
+          cb (step, arg);
+        }
+      return;
+    }
+
+  g_mutex_init (&work->lock);
+  g_cond_init (&work->cond);
+
+  for (i = 0; i < count; ++i)
+    {
+      g_thread_pool_push (pool, GSIZE_TO_POINTER (i + 1), NULL);
+    }
+
+  g_mutex_lock (&work->lock);
+  for (done = 0; done < count;)
+    {
+      while (work->done == done)
+        {
+          g_cond_wait (&work->cond, &work->lock);
+        }
+      done = work->done;
+
+      g_mutex_unlock (&work->lock);
+      step->now = done;
+      cb (step, arg);
+      g_mutex_lock (&work->lock);
+    }
+  g_mutex_unlock (&work->lock);
+
+  g_thread_pool_free (pool, FALSE, TRUE);
+
+  g_cond_clear (&work->cond);
+  g_mutex_clear (&work->lock);
+}
+
+static void
+image_hash_func (gsize i, struct st_hashs *job)
+{
+  const gchar *path;
+
+  if (job->reps[i] != i)
+    {
+      return;
+    }
+
+  path = (const gchar *)g_ptr_array_index (job->ptr, i);
+  job->hashs[i] = g_ini->image_symmetric ? image_file_sphash (path)
+                                         : image_file_hash (path);
+}
+
+static void
+ebook_hash_func (gsize i, struct st_hashs *job)
 {
-  file->head->hash = video_time_hash (file->path, file->offset);
-  file->tail->hash = video_time_hash (file->path, file->length - file->offset);
-  return 0;
+  if (job->reps[i] != i)
+    {
+      return;
+    }
+
+  ebook_file_hash ((const gchar *)g_ptr_array_index (job->ptr, i),
+                   job->ebooks + i);
 }
 
+/* every block of files queries the domain on its own thread, the
+ * indexes are read only once built */
 static int
-audio_hashes_func (struct st_file *file)
+find_matches (match_domain_t *domain, const guint *reps, gsize block,
+              GCancellable *cancel, find_step *step, find_step_cb cb,
+              gpointer arg)
+{
+  struct st_match job[1];
+  const gchar **paths;
+  GArray *matches;
+  guint i;
+  int count;
+
+  job->domain = domain;
+  job->n = match_domain_size (domain);
+  job->block = block;
+  job->reps = reps;
+  matches = compare_tasks ((job->n + block - 1) / block,
+                           (compare_task_func)find_match_task, job, cancel,
+                           step, cb, arg);
+
+  if (!image_verify (domain, matches, cancel, step, cb, arg))
+    {
+      g_array_free (matches, TRUE);
+      return 0;
+    }
+
+  paths = g_new (const gchar *, job->n);
+  for (i = 0; i < job->n; ++i)
+    {
+      paths[i] = match_domain_path (domain, i);
+    }
+  count = compare_report (matches, paths, step, cb, arg);
+  g_array_free (matches, TRUE);
+  g_free (paths);
+
+  return count;
+}
+
+static void
+find_match_task (gsize task, struct st_match *job, GArray *out)
+{
+  gsize i, end;
+
+  end = MIN ((task + 1) * job->block, job->n);
+  for (i = task * job->block; i < end; ++i)
+    {
+      match_domain_query (job->domain, i, (match_skip_func)find_same_rep,
+                          job, out);
+    }
+}
+
+/* copies of one content, find_copies reported them */
+static gboolean
+find_same_rep (guint a, guint b, struct st_match *job)
+{
+  return job->reps[a] == job->reps[b];
+}
+
+/* the 64 bits hashes only found the candidates, the larger signatures of
+ * their files decide; FALSE when cancelled */
+static gboolean
+image_verify (match_domain_t *domain, GArray *matches, GCancellable *cancel,
+              find_step *step, find_step_cb cb, gpointer arg)
+{
+  struct st_match job[1];
+  compare_match *match;
+  guint8 *seen;
+  GArray *ids;
+  gsize i, kept;
+
+  if (!match_domain_verifies (domain) || matches->len == 0)
+    {
+      return TRUE;
+    }
+
+  seen = g_new0 (guint8, match_domain_size (domain));
+  ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (i = 0; i < matches->len; ++i)
+    {
+      match = &g_array_index (matches, compare_match, i);
+      if (!seen[match->a])
+        {
+          seen[match->a] = 1;
+          g_array_append_val (ids, match->a);
+        }
+      if (!seen[match->b])
+        {
+          seen[match->b] = 1;
+          g_array_append_val (ids, match->b);
+        }
+    }
+  g_free (seen);
+
+  /* every file signed once on the pool, the matches only read them */
+  job->domain = domain;
+  job->ids = (guint *)ids->data;
+  step->total = ids->len;
+  step->doing = _ ("Verify image candidates");
+  find_parallel (ids->len, (st_work_func)image_sign_func, job, cancel, step,
+                 cb, arg);
+  g_array_free (ids, TRUE);
+  if (g_cancellable_is_cancelled (cancel))
+    {
+      return FALSE;
+    }
+
+  for (i = 0, kept = 0; i < matches->len; ++i)
+    {
+      match = &g_array_index (matches, compare_match, i);
+      if (match_domain_verify (domain, match))
+        {
+          g_array_index (matches, compare_match, kept++) = *match;
+        }
+    }
+  g_array_set_size (matches, kept);
+
+  return TRUE;
+}
+
+static void
+image_sign_func (gsize k, struct st_match *job)
+{
+  match_domain_sign (job->domain, job->ids[k]);
+}
+
+static void
+video_hash_func (struct st_file *file, struct st_find *find)
+{
+  int g, n;
+  float offsets[0x20];
+  hash_t hashs[0x20];
+
+  if (g_cancellable_is_cancelled (find->cancel))
+    {
+      return;
+    }
+
+  if (g_ini->video_frames > 0)
+    {
+      file->file.frames = g_new0 (hash_t, g_ini->video_frames);
+      fd_push_cancel (find->cancel);
+      video_frames_hash (file->path, file->file.length, g_ini->video_frames,
+                         file->file.frames);
+      fd_pop_cancel (find->cancel);
+      return;
+    }
+
+  /* the head and tail of every group from one decoder session */
+  n = 0;
+  for (g = 0; g_ini->video_timers[g][0]; ++g)
+    {
+      if (file->groups & (1u << g))
+        {
+          offsets[n++] = g_ini->video_timers[g][2];
+          offsets[n++] = file->file.length - g_ini->video_timers[g][2];
+        }
+    }
+
+  fd_push_cancel (find->cancel);
+  video_times_hash (file->path, offsets, n, hashs);
+  fd_pop_cancel (find->cancel);
+
+  n = 0;
+  for (g = 0; g_ini->video_timers[g][0]; ++g)
+    {
+      if (file->groups & (1u << g))
+        {
+          file->file.heads[g] = hashs[n++];
+          file->file.tails[g] = hashs[n++];
+        }
+    }
+}
+
+static void
+audio_hashes_func (struct st_file *file, struct st_find *find)
 {
-  file->hashArray = audio_hashes (file->path);
-  return 0;
+  if (g_cancellable_is_cancelled (find->cancel))
+    {
+      return;
+    }
+
+  fd_push_cancel (find->cancel);
+  file->file.peaks = audio_hashes (file->path);
+  fd_pop_cancel (find->cancel);
 }
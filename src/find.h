@@ -27,6 +27,7 @@
 #ifndef _FDUPVES_FIND_H_
 #define _FDUPVES_FIND_H_
 
+#include <gio/gio.h>
 #include <glib.h>
 
 typedef enum
@@ -65,6 +66,7 @@ typedef enum
   FD_SAME_AUDIO_HEAD,
   FD_SAME_AUDIO_TAIL,
   FD_SAME_EBOOK,
+  FD_SAME_VIDEO_FRAMES,
 } same_type;
 
 typedef struct
@@ -76,16 +78,31 @@ typedef struct
   same_type type;
   const gchar *afile;
   const gchar *bfile;
+
+  /* seconds, where afile starts inside bfile when aligned,
+   * negative when bfile starts inside afile */
+  float offset;
+
+  /* afile and bfile were the same in the last scan, but are no more */
+  gboolean removed;
+
+  /* hamming distance of the hashes matched, -1 when there is none:
+   * audio, or a pair replayed from the last scan */
+  int distance;
 } find_step;
 
 typedef void (*find_step_cb) (const find_step *, gpointer);
 
-int find_images (GPtrArray *, find_step_cb, gpointer);
+/* a short ascii name, for the text and json outputs */
+const gchar *find_type_name (same_type);
+
+/* a cancelled find stops within one file, cancel may be NULL */
+int find_images (GPtrArray *, GCancellable *, find_step_cb, gpointer);
 
-int find_videos (GPtrArray *, find_step_cb, gpointer);
+int find_videos (GPtrArray *, GCancellable *, find_step_cb, gpointer);
 
-int find_audios (GPtrArray *, find_step_cb, gpointer);
+int find_audios (GPtrArray *, GCancellable *, find_step_cb, gpointer);
 
-int find_ebooks (GPtrArray *, find_step_cb, gpointer);
+int find_ebooks (GPtrArray *, GCancellable *, find_step_cb, gpointer);
 
 #endif
@@ -0,0 +1,184 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE group.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "group.h"
+
+#include <glib.h>
+
+struct same_group_s
+{
+  /* path -> id + 1 */
+  GHashTable *ids;
+
+  /* id -> path, owned */
+  GPtrArray *paths;
+
+  /* id -> parent id */
+  GArray *parents;
+
+  /* root id -> set size */
+  GArray *sizes;
+};
+
+same_group_t *
+same_group_new ()
+{
+  same_group_t *group;
+
+  group = g_new0 (same_group_t, 1);
+  g_return_val_if_fail (group, NULL);
+
+  group->ids = g_hash_table_new (g_str_hash, g_str_equal);
+  group->paths = g_ptr_array_new_with_free_func (g_free);
+  group->parents = g_array_new (FALSE, FALSE, sizeof (guint));
+  group->sizes = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  return group;
+}
+
+void
+same_group_free (same_group_t *group)
+{
+  g_hash_table_destroy (group->ids);
+  g_ptr_array_free (group->paths, TRUE);
+  g_array_free (group->parents, TRUE);
+  g_array_free (group->sizes, TRUE);
+  g_free (group);
+}
+
+guint
+same_group_intern (same_group_t *group, const gchar *path)
+{
+  gpointer value;
+  gchar *dup;
+  guint id, one;
+
+  value = g_hash_table_lookup (group->ids, path);
+  if (value)
+    {
+      return GPOINTER_TO_UINT (value) - 1;
+    }
+
+  id = group->paths->len;
+  dup = g_strdup (path);
+  g_ptr_array_add (group->paths, dup);
+  g_hash_table_insert (group->ids, dup, GUINT_TO_POINTER (id + 1));
+
+  one = 1;
+  g_array_append_val (group->parents, id);
+  g_array_append_val (group->sizes, one);
+
+  return id;
+}
+
+const gchar *
+same_group_path (same_group_t *group, guint id)
+{
+  return g_ptr_array_index (group->paths, id);
+}
+
+gsize
+same_group_size (same_group_t *group)
+{
+  return group->paths->len;
+}
+
+guint
+same_group_find (same_group_t *group, guint id)
+{
+  guint *parents;
+
+  /* path halving */
+  parents = (guint *)group->parents->data;
+  while (parents[id] != id)
+    {
+      parents[id] = parents[parents[id]];
+      id = parents[id];
+    }
+
+  return id;
+}
+
+guint
+same_group_union (same_group_t *group, guint a, guint b)
+{
+  guint *sizes, t;
+
+  a = same_group_find (group, a);
+  b = same_group_find (group, b);
+  if (a == b)
+    {
+      return a;
+    }
+
+  sizes = (guint *)group->sizes->data;
+  if (sizes[a] < sizes[b])
+    {
+      t = a;
+      a = b;
+      b = t;
+    }
+
+  g_array_index (group->parents, guint, b) = a;
+  sizes[a] += sizes[b];
+
+  return a;
+}
+
+GPtrArray *
+same_group_collect (same_group_t *group)
+{
+  GPtrArray *sets;
+  GArray **byroot, *set;
+  guint id, root, n;
+
+  n = group->paths->len;
+  sets = g_ptr_array_new_with_free_func ((GDestroyNotify)g_array_unref);
+  byroot = g_new0 (GArray *, MAX (n, 1));
+
+  for (id = 0; id < n; ++id)
+    {
+      root = same_group_find (group, id);
+      if (g_array_index (group->sizes, guint, root) < 2)
+        {
+          continue;
+        }
+
+      set = byroot[root];
+      if (set == NULL)
+        {
+          set = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+                                   g_array_index (group->sizes, guint, root));
+          byroot[root] = set;
+          g_ptr_array_add (sets, set);
+        }
+      g_array_append_val (set, id);
+    }
+
+  g_free (byroot);
+
+  return sets;
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE group.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_GROUP_H_
+#define _FDUPVES_GROUP_H_
+
+#include <glib.h>
+
+/* disjoint set over interned paths:
+ * every reported pair joins the two sets, so groups bridged by a later
+ * pair merge as well.
+ */
+typedef struct same_group_s same_group_t;
+
+same_group_t *same_group_new ();
+
+void same_group_free (same_group_t *);
+
+guint same_group_intern (same_group_t *, const gchar *);
+
+const gchar *same_group_path (same_group_t *, guint);
+
+gsize same_group_size (same_group_t *);
+
+guint same_group_find (same_group_t *, guint);
+
+guint same_group_union (same_group_t *, guint, guint);
+
+/* every set with at least two paths, as a GArray of guint ids,
+ * sets are ordered by their first interned id, ids ascending */
+GPtrArray *same_group_collect (same_group_t *);
+
+#endif
@@ -31,6 +31,7 @@
 #include "find.h"
 #include "image.h"
 #include "ini.h"
+#include "scan.h"
 #include "util.h"
 #include "video.h"
 
@@ -44,6 +45,16 @@
 #include <windows.h>
 #endif
 
+/* milliseconds between two progress updates */
+#ifndef FD_GUI_TICK
+#define FD_GUI_TICK 100
+#endif
+
+/* pairs handed to the main loop at once */
+#ifndef FD_GUI_BATCH
+#define FD_GUI_BATCH 256
+#endif
+
 typedef struct
 {
   same_type type;
@@ -54,6 +65,34 @@ typedef struct
 
 void same_node_free (same_node *);
 
+/* a pair found by a worker, waiting for the main loop */
+struct gui_pair
+{
+  gchar *afile;
+  gchar *bfile;
+  same_type type;
+};
+
+struct gui_batch
+{
+  gui_t *gui;
+  GPtrArray *pairs;
+};
+
+/* the groups of a finished find, turned into same nodes */
+struct gui_flush
+{
+  gui_t *gui;
+  same_group_t *groups[0x10];
+  GSList *nodes;
+};
+
+struct gui_log_line
+{
+  gui_t *gui;
+  gchar *text;
+};
+
 void same_list_free (GSList *);
 
 struct file_node_s
@@ -150,6 +189,8 @@ static void gui_add_cb (GtkWidget *, gui_t *);
 
 static void gui_find_cb (GtkWidget *, gui_t *);
 
+static void gui_stop_cb (GtkWidget *, gui_t *);
+
 static void gui_delsel_cb (GtkWidget *, gui_t *);
 
 static void gui_pref_cb (GtkWidget *, gui_t *);
@@ -160,8 +201,32 @@ static void gui_help_cb (GtkWidget *, gui_t *);
 
 static void gui_find_step_cb (const find_step *, gui_t *);
 
-static GSList *gui_append_same_slist (gui_t *, GSList *, const gchar *,
-                                      const gchar *, same_type);
+static gboolean gui_progress_timeout (gui_t *);
+
+static struct gui_pair *gui_pair_new (const find_step *);
+
+static void gui_pair_free (struct gui_pair *);
+
+static void gui_found_post (gui_t *, GPtrArray *);
+
+static gboolean gui_found_invoke (struct gui_batch *);
+
+static void gui_found_apply (gui_t *, GPtrArray *);
+
+static void gui_found_drain (gui_t *);
+
+static gboolean gui_find_done (gui_t *);
+
+static gboolean gui_log_idle (struct gui_log_line *);
+
+static void gui_group_same_pair (gui_t *, const gchar *, const gchar *,
+                                 same_type);
+
+static gpointer gui_flush_thread (struct gui_flush *);
+
+static gboolean gui_flush_done (struct gui_flush *);
+
+static void gui_same_node_to_tree (gui_t *, same_node *);
 
 static gui_t gui[1];
 
@@ -178,13 +243,7 @@ static void gui_save_directories (gui_t *);
 static void gui_load_directories (gui_t *);
 
 static gboolean dir_find_item (GtkTreeModel *, GtkTreePath *, GtkTreeIter *,
-                               gui_t *);
-
-static void gui_list_dir (gui_t *, const gchar *);
-
-static void gui_list_file (gui_t *, const gchar *);
-
-static void gui_list_link (gui_t *, const gchar *);
+                               scan_t *);
 
 static void restree_sel_small_file (same_node *node, gui_t *);
 
@@ -252,6 +311,9 @@ gui_init (int argc, char *argv[])
     }
 
   gui->quit = FALSE;
+  gui->cancel = g_cancellable_new ();
+  g_mutex_init (&gui->found_lock);
+  gui->found = g_ptr_array_new_with_free_func ((GDestroyNotify)gui_pair_free);
 
   gui->widget = gtk_window_new (GTK_WINDOW_TOPLEVEL);
 
@@ -354,6 +416,16 @@ toolbar_new (gui_t *gui)
                     G_CALLBACK (gui_find_cb), gui);
   gtk_toolbar_insert (GTK_TOOLBAR (toolbar), gui->but_find, -1);
 
+  img = gtk_image_new_from_icon_name ("process-stop",
+                                      GTK_ICON_SIZE_LARGE_TOOLBAR);
+  gui->but_stop = gtk_tool_button_new (img, _ ("Stop"));
+  gtk_widget_set_tooltip_text (GTK_WIDGET (gui->but_stop),
+                               _ ("Stop Finding"));
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_stop), FALSE);
+  g_signal_connect (G_OBJECT (gui->but_stop), "clicked",
+                    G_CALLBACK (gui_stop_cb), gui);
+  gtk_toolbar_insert (GTK_TOOLBAR (toolbar), gui->but_stop, -1);
+
   img = fd_toolbar_icon_new ("del.png");
   gui->but_del = gtk_tool_button_new (img, _ ("Delete Selected"));
   gtk_widget_set_tooltip_text (GTK_WIDGET (gui->but_del),
@@ -409,34 +481,56 @@ static void
 gui_log (const gchar *log_domain, GLogLevelFlags log_level,
          const gchar *message, gpointer user_data)
 {
-  GtkTreeIter itr[1];
-  GtkTreePath *path;
+  struct gui_log_line *line;
   gui_t *gui;
   gchar fmt_message[1024];
 
-  gui_log_format (fmt_message, sizeof fmt_message, message);
-
   gui = (gui_t *)user_data;
 
   if (gui->quit)
     return;
 
-  gdk_threads_enter ();
-  gtk_list_store_append (gui->logliststore, itr);
-  gtk_list_store_set (gui->logliststore, itr, 0, fmt_message, -1);
+  /* any thread may log, the list is only filled by the main loop */
+  gui_log_format (fmt_message, sizeof fmt_message, message);
+  line = g_new (struct gui_log_line, 1);
+  line->gui = gui;
+  line->text = g_strdup (fmt_message);
+  gdk_threads_add_idle ((GSourceFunc)gui_log_idle, line);
+}
 
-  path = gtk_tree_model_get_path (GTK_TREE_MODEL (gui->logliststore), itr);
-  gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (gui->logtree), path, NULL,
-                                FALSE, 0.0, 0.0);
-  gtk_tree_path_free (path);
+static gboolean
+gui_log_idle (struct gui_log_line *line)
+{
+  GtkTreeIter itr[1];
+  GtkTreePath *path;
+  gui_t *gui;
 
-  if (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (gui->logliststore), NULL)
-      >= FDUPVES_MAXLOG)
+  gui = line->gui;
+  if (!gui->quit)
     {
-      gtk_tree_model_get_iter_first (GTK_TREE_MODEL (gui->logliststore), itr);
-      gtk_list_store_remove (gui->logliststore, itr);
+      gtk_list_store_append (gui->logliststore, itr);
+      gtk_list_store_set (gui->logliststore, itr, 0, line->text, -1);
+
+      path = gtk_tree_model_get_path (GTK_TREE_MODEL (gui->logliststore),
+                                      itr);
+      gtk_tree_view_scroll_to_cell (GTK_TREE_VIEW (gui->logtree), path, NULL,
+                                    FALSE, 0.0, 0.0);
+      gtk_tree_path_free (path);
+
+      if (gtk_tree_model_iter_n_children (
+              GTK_TREE_MODEL (gui->logliststore), NULL)
+          >= FDUPVES_MAXLOG)
+        {
+          gtk_tree_model_get_iter_first (GTK_TREE_MODEL (gui->logliststore),
+                                         itr);
+          gtk_list_store_remove (gui->logliststore, itr);
+        }
     }
-  gdk_threads_leave ();
+
+  g_free (line->text);
+  g_free (line);
+
+  return FALSE;
 }
 
 static void
@@ -800,10 +894,40 @@ gui_find_cb (GtkWidget *wid, gui_t *gui)
 {
   GThread *th;
 
+  /* disable the add/find tool time */
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_add), FALSE);
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_find), FALSE);
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_del), FALSE);
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_stop), TRUE);
+  g_cancellable_reset (gui->cancel);
+
+  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress), "");
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress), 0);
+
+  gtk_tree_store_clear (gui->restreestore);
+  if (gui->same_list)
+    {
+      same_list_free (gui->same_list);
+      gui->same_list = NULL;
+    }
+
+  g_atomic_int_set (&gui->step_now, 0);
+  g_atomic_int_set (&gui->step_total, 0);
+  g_atomic_pointer_set (&gui->step_doing, NULL);
+  gui->step_timer = gdk_threads_add_timeout (
+      FD_GUI_TICK, (GSourceFunc)gui_progress_timeout, gui);
+
   th = g_thread_try_new ("find", (GThreadFunc)gui_find_thread, gui, NULL);
   g_thread_unref (th);
 }
 
+static void
+gui_stop_cb (GtkWidget *wid, gui_t *gui)
+{
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_stop), FALSE);
+  g_cancellable_cancel (gui->cancel);
+}
+
 static void
 gui_save_directories (gui_t *gui)
 {
@@ -853,102 +977,43 @@ gui_load_directories (gui_t *gui)
 static void
 gui_find_thread (gui_t *gui)
 {
-  int fimage, fvideo, faudio, febook;
-
-  /* disable the add/find tool time */
-  gdk_threads_enter ();
-  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_add), FALSE);
-  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_find), FALSE);
-  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_del), FALSE);
-
-  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress), "");
-  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress), 0);
-
-  gtk_tree_store_clear (gui->restreestore);
-  if (gui->same_list)
-    {
-      same_list_free (gui->same_list);
-      gui->same_list = NULL;
-    }
-  gdk_threads_leave ();
-
-  gui->images = g_ptr_array_new_with_free_func (g_free);
-  gui->videos = g_ptr_array_new_with_free_func (g_free);
-  gui->audios = g_ptr_array_new_with_free_func (g_free);
-  gui->ebooks = g_ptr_array_new_with_free_func (g_free);
+  scan_t *scan;
+  int count;
 
+  scan = scan_new ((find_step_cb)gui_find_step_cb, gui);
+  scan_set_cancellable (scan, gui->cancel);
   gtk_tree_model_foreach (GTK_TREE_MODEL (gui->dirliststore),
-                          (GtkTreeModelForeachFunc)dir_find_item, gui);
-
-  fimage = 0;
-  if (g_ini->proc_image && gui->images->len > 0)
-    {
-      g_message (_ ("find %d images to process"), gui->images->len);
-
-      find_images (gui->images, (find_step_cb)gui_find_step_cb, gui);
-      fimage = g_slist_length (gui->same_list);
-      g_message (_ ("find %d groups same images"), fimage);
-    }
-
-  fvideo = 0;
-  if (g_ini->proc_video && gui->videos->len > 0)
-    {
-      g_message (_ ("find %d videos to process"), gui->videos->len);
+                          (GtkTreeModelForeachFunc)dir_find_item, scan);
 
-      if (g_ini->compare_area == FD_COMPARE_AUDIO_IN_VIDEO)
-        {
-          find_audios (gui->videos, (find_step_cb)gui_find_step_cb, gui);
-        }
-      else
-        {
-          find_videos (gui->videos, (find_step_cb)gui_find_step_cb, gui);
-        }
-      fvideo = g_slist_length (gui->same_list);
-      fvideo -= fimage;
-      g_message (_ ("find %d groups same videos"), fvideo);
-    }
+  /* every media type is walked, hashed and compared in one pass */
+  count = scan_run (scan);
+  scan_free (scan);
+  g_message (_ ("find %d same pairs"), count);
 
-  faudio = 0;
-  if (g_ini->proc_audio && gui->audios->len > 0)
-    {
-      g_message (_ ("find %d audios to process"), gui->audios->len);
-
-      find_audios (gui->audios, (find_step_cb)gui_find_step_cb, gui);
-      faudio = g_slist_length (gui->same_list);
-      faudio -= fimage;
-      faudio -= fvideo;
-      g_message (_ ("find %d groups same audios"), faudio);
-    }
-
-  febook = 0;
-  if (g_ini->proc_ebook && gui->ebooks->len > 0)
-    {
-      g_message (_ ("find %d ebooks to process"), gui->ebooks->len);
+  /* the batches posted before run first, they have a higher priority */
+  gdk_threads_add_idle ((GSourceFunc)gui_find_done, gui);
+}
 
-      find_ebooks (gui->ebooks, (find_step_cb)gui_find_step_cb, gui);
-      febook = g_slist_length (gui->same_list);
-      febook -= fimage;
-      febook -= fvideo;
-      febook -= faudio;
-      g_message (_ ("find %d groups same audios"), febook);
-    }
+/* in the main loop, once every pair of the find is grouped: the groups
+ * go to a thread of their own */
+static gboolean
+gui_find_done (gui_t *gui)
+{
+  struct gui_flush *flush;
 
-  g_ptr_array_free (gui->images, TRUE);
-  g_ptr_array_free (gui->videos, TRUE);
-  g_ptr_array_free (gui->audios, TRUE);
-  g_ptr_array_free (gui->ebooks, TRUE);
+  g_source_remove (gui->step_timer);
+  gui->step_timer = 0;
 
-  gdk_threads_enter ();
-  gtk_tree_view_expand_all (GTK_TREE_VIEW (gui->restree));
+  gui_found_drain (gui);
 
-  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress), 0);
-  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress), "");
+  flush = g_new0 (struct gui_flush, 1);
+  flush->gui = gui;
+  memcpy (flush->groups, gui->same_groups, sizeof flush->groups);
+  memset (gui->same_groups, 0, sizeof gui->same_groups);
+  g_thread_unref (
+      g_thread_new ("flush", (GThreadFunc)gui_flush_thread, flush));
 
-  /* disable the add/find tool time */
-  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_add), TRUE);
-  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_find), TRUE);
-  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_del), TRUE);
-  gdk_threads_leave ();
+  return FALSE;
 }
 
 static void
@@ -1118,140 +1183,20 @@ gui_help_cb (GtkWidget *wid, gui_t *gui)
 
 static gboolean
 dir_find_item (GtkTreeModel *model, GtkTreePath *tpath, GtkTreeIter *itr,
-               gui_t *gui)
+               scan_t *scan)
 {
   gchar *path;
 
   gtk_tree_model_get (model, itr, 0, &path, -1);
   if (path)
     {
-      if (g_file_test (path, G_FILE_TEST_IS_DIR))
-        {
-          gui_list_dir (gui, path);
-        }
-      else if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
-        {
-          gui_list_file (gui, path);
-        }
-      else if (g_file_test (path, G_FILE_TEST_IS_SYMLINK))
-        {
-          gui_list_link (gui, path);
-        }
-
+      scan_add (scan, path);
       g_free (path);
     }
 
   return FALSE;
 }
 
-static void
-gui_list_dir (gui_t *gui, const gchar *path)
-{
-  GQueue stack[1];
-  GDir *gdir;
-  GError *err;
-  gchar *dir, *curpath;
-  const gchar *cur;
-
-  g_queue_init (stack);
-  dir = g_strdup (path);
-  g_queue_push_tail (stack, dir);
-
-  while ((dir = g_queue_pop_tail (stack)) != NULL)
-    {
-      err = NULL;
-      gdir = g_dir_open (dir, 0, &err);
-      if (err)
-        {
-          g_warning ("Can't open dir: %s: %s", dir, err->message);
-          g_error_free (err);
-        }
-
-      while ((cur = g_dir_read_name (gdir)) != NULL)
-        {
-          if (strcmp (cur, ".") == 0 || strcmp (cur, "..") == 0)
-            {
-              continue;
-            }
-
-          curpath = g_build_filename (dir, cur, NULL);
-          if (g_file_test (curpath, G_FILE_TEST_IS_DIR))
-            {
-              g_queue_push_tail (stack, curpath);
-            }
-          else if (g_file_test (curpath, G_FILE_TEST_IS_REGULAR))
-            {
-              gui_list_file (gui, curpath);
-              g_free (curpath);
-            }
-          else if (g_file_test (curpath, G_FILE_TEST_IS_SYMLINK))
-            {
-              gui_list_link (gui, curpath);
-              g_free (curpath);
-            }
-        }
-
-      g_dir_close (gdir);
-      g_free (dir);
-    }
-}
-
-static void
-gui_list_file (gui_t *gui, const gchar *path)
-{
-  gchar *p;
-  int found;
-
-  found = 0;
-  if (g_ini->proc_image && is_image (path))
-    {
-      p = g_strdup (path);
-      g_ptr_array_add (gui->images, p);
-      found = 1;
-    }
-
-  if (g_ini->proc_video && is_video (path))
-    {
-      p = g_strdup (path);
-      g_ptr_array_add (gui->videos, p);
-      found = 1;
-    }
-
-  if (g_ini->proc_audio && is_audio (path))
-    {
-      p = g_strdup (path);
-      g_ptr_array_add (gui->audios, p);
-      found = 1;
-    }
-
-  if (g_ini->proc_ebook && is_ebook (path))
-    {
-      p = g_strdup (path);
-      g_ptr_array_add (gui->ebooks, p);
-      found = 1;
-    }
-
-  if (g_ini->compare_area == 5 && is_video (path))
-    {
-      p = g_strdup (path);
-      g_ptr_array_add (gui->audios, p);
-      found = 1;
-    }
-
-  if (found == 0)
-    {
-      g_debug ("%s is not image/video/audio/e-book, skipped", path);
-      if (g_ini->proc_other)
-        {
-        }
-    }
-}
-
-static void
-gui_list_link (gui_t *gui, const gchar *path)
-{
-}
-
 static void
 gui_destroy_cb (GtkWidget *but, GdkEvent *ev, gui_t *gui)
 {
@@ -1276,6 +1221,7 @@ static void
 gui_destroy (gui_t *gui)
 {
   gui->quit = TRUE;
+  g_cancellable_cancel (gui->cancel);
 
   gui_save_directories (gui);
   ini_save (g_ini, FD_USR_CONF_FILE);
@@ -1518,8 +1464,6 @@ restree_opendir (GtkMenuItem *item, gui_t *gui)
 static void
 gui_filter_result (gui_t *gui, const gchar *filter)
 {
-  GtkTreeIter itr[1], itrc[1];
-  GtkTreePath *path;
   GSList *nodelist, *filelist;
   same_node *node;
   file_node *fn;
@@ -1567,25 +1511,7 @@ gui_filter_result (gui_t *gui, const gchar *filter)
 
       if (match)
         {
-          gtk_tree_store_append (gui->restreestore, itr, NULL);
-          fn = node->files->data;
-          file_node_to_tree_iter (fn, gui->restreestore, itr);
-
-          path = gtk_tree_model_get_path (GTK_TREE_MODEL (gui->restreestore),
-                                          itr);
-          node->treerowref = gtk_tree_row_reference_new (
-              GTK_TREE_MODEL (gui->restreestore), path);
-          gtk_tree_path_free (path);
-
-          for (filelist = g_slist_next (node->files); filelist != NULL;
-               filelist = g_slist_next (filelist))
-            {
-              gtk_tree_store_append (gui->restreestore, itrc, itr);
-              fn = filelist->data;
-              file_node_to_tree_iter (fn, gui->restreestore, itrc);
-            }
-
-          node->show = TRUE;
+          gui_same_node_to_tree (gui, node);
         }
     }
 
@@ -2052,47 +1978,160 @@ diffdia_onseekchanged (GtkEntry *entry, diff_dialog *dia)
   diffdia_refresh_video_pic (dia);
 }
 
+/* on any worker thread: no GTK call, no GDK lock */
 static void
 gui_find_step_cb (const find_step *step, gui_t *gui)
 {
+  GPtrArray *full;
+
   if (step->doing)
     {
-      gdk_threads_enter ();
-      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress),
-                                 step->doing);
-      gdk_threads_leave ();
+      g_atomic_pointer_set (&gui->step_doing, (gpointer)step->doing);
     }
 
-  if (step->total > 0 && step->now < step->total)
+  if (step->total > 0)
     {
-      gdk_threads_enter ();
-      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress),
-                                     (gdouble)step->now
-                                         / (gdouble)step->total);
-      gdk_threads_leave ();
+      g_atomic_int_set (&gui->step_total, (gint)step->total);
+      g_atomic_int_set (&gui->step_now, (gint)step->now);
     }
 
   if (step->found)
     {
-      gui->same_list = gui_append_same_slist (gui, gui->same_list, step->afile,
-                                              step->bfile, step->type);
+      full = NULL;
+      g_mutex_lock (&gui->found_lock);
+      g_ptr_array_add (gui->found, gui_pair_new (step));
+      if (gui->found->len >= FD_GUI_BATCH)
+        {
+          full = gui->found;
+          gui->found = g_ptr_array_new_with_free_func (
+              (GDestroyNotify)gui_pair_free);
+        }
+      g_mutex_unlock (&gui->found_lock);
+
+      if (full)
+        {
+          gui_found_post (gui, full);
+        }
+    }
+  else if (step->removed)
+    {
+      g_message (_ ("%s and %s are not the same any more"), step->afile,
+                 step->bfile);
     }
 }
 
-static GSList *
-gui_append_same_slist (gui_t *gui, GSList *slist, const gchar *afile,
-                       const gchar *bfile, same_type type)
+static gboolean
+gui_progress_timeout (gui_t *gui)
+{
+  const gchar *doing;
+  gint now, total;
+
+  doing = g_atomic_pointer_get (&gui->step_doing);
+  if (doing)
+    {
+      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress), doing);
+    }
+
+  total = g_atomic_int_get (&gui->step_total);
+  now = g_atomic_int_get (&gui->step_now);
+  if (total > 0 && now < total)
+    {
+      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress),
+                                     (gdouble)now / (gdouble)total);
+    }
+
+  /* the pairs of a batch not full yet */
+  gui_found_drain (gui);
+
+  return TRUE;
+}
+
+static struct gui_pair *
+gui_pair_new (const find_step *step)
+{
+  struct gui_pair *pair;
+
+  pair = g_new (struct gui_pair, 1);
+  pair->afile = g_strdup (step->afile);
+  pair->bfile = g_strdup (step->bfile);
+  pair->type = step->type;
+
+  return pair;
+}
+
+static void
+gui_pair_free (struct gui_pair *pair)
+{
+  g_free (pair->afile);
+  g_free (pair->bfile);
+  g_free (pair);
+}
+
+static void
+gui_found_post (gui_t *gui, GPtrArray *pairs)
+{
+  struct gui_batch *batch;
+
+  batch = g_new (struct gui_batch, 1);
+  batch->gui = gui;
+  batch->pairs = pairs;
+  g_main_context_invoke (NULL, (GSourceFunc)gui_found_invoke, batch);
+}
+
+static gboolean
+gui_found_invoke (struct gui_batch *batch)
+{
+  gui_found_apply (batch->gui, batch->pairs);
+  g_free (batch);
+
+  return FALSE;
+}
+
+static void
+gui_found_apply (gui_t *gui, GPtrArray *pairs)
+{
+  struct gui_pair *pair;
+  guint i;
+
+  for (i = 0; i < pairs->len; ++i)
+    {
+      pair = g_ptr_array_index (pairs, i);
+      gui_group_same_pair (gui, pair->afile, pair->bfile, pair->type);
+    }
+  g_ptr_array_free (pairs, TRUE);
+}
+
+static void
+gui_found_drain (gui_t *gui)
+{
+  GPtrArray *pairs;
+
+  pairs = NULL;
+  g_mutex_lock (&gui->found_lock);
+  if (gui->found->len > 0)
+    {
+      pairs = gui->found;
+      gui->found = g_ptr_array_new_with_free_func (
+          (GDestroyNotify)gui_pair_free);
+    }
+  g_mutex_unlock (&gui->found_lock);
+
+  if (pairs)
+    {
+      gui_found_apply (gui, pairs);
+    }
+}
+
+static void
+gui_group_same_pair (gui_t *gui, const gchar *afile, const gchar *bfile,
+                     same_type type)
 {
-  GSList *cur, *fslist;
-  same_node *node;
-  file_node *fn, *fn2;
-  gboolean afind, bfind;
-  GtkTreeIter itr[1], itrc[1];
-  GtkTreePath *path;
   int filetype;
+  same_group_t *group;
 
   filetype = FD_IMAGE;
-  if (type == FD_SAME_VIDEO_HEAD || type == FD_SAME_VIDEO_TAIL)
+  if (type == FD_SAME_VIDEO_HEAD || type == FD_SAME_VIDEO_TAIL
+      || type == FD_SAME_VIDEO_FRAMES)
     {
       filetype = FD_VIDEO;
     }
@@ -2100,93 +2139,131 @@ gui_append_same_slist (gui_t *gui, GSList *slist, const gchar *afile,
     {
       filetype = FD_AUDIO;
     }
+  else if (type == FD_SAME_EBOOK)
+    {
+      filetype = FD_EBOOK;
+    }
 
-  for (cur = slist; cur; cur = g_slist_next (cur))
+  group = gui->same_groups[filetype];
+  if (group == NULL)
     {
-      node = cur->data;
+      group = same_group_new ();
+      gui->same_groups[filetype] = group;
+    }
 
-      if (node->type != filetype)
+  same_group_union (group, same_group_intern (group, afile),
+                    same_group_intern (group, bfile));
+}
+
+/* on the flush thread: turn the grouped pairs into same nodes, reading
+ * the file details takes a while */
+static gpointer
+gui_flush_thread (struct gui_flush *flush)
+{
+  int filetype;
+  guint g, i;
+  GPtrArray *sets;
+  GArray *set;
+  same_group_t *group;
+  same_node *node;
+
+  flush->nodes = NULL;
+  for (filetype = 0; filetype < G_N_ELEMENTS (flush->groups); ++filetype)
+    {
+      group = flush->groups[filetype];
+      if (group == NULL)
         {
           continue;
         }
 
-      afind = bfind = FALSE;
-      for (fslist = node->files; fslist; fslist = g_slist_next (fslist))
+      sets = same_group_collect (group);
+      for (g = 0; g < sets->len; ++g)
         {
-          fn = fslist->data;
+          set = g_ptr_array_index (sets, g);
 
-          if (strcmp (fn->path, afile) == 0)
-            {
-              afind = TRUE;
-            }
-          else if (strcmp (fn->path, bfile) == 0)
+          node = g_malloc0 (sizeof (same_node));
+          node->type = filetype;
+          for (i = 0; i < set->len; ++i)
             {
-              bfind = TRUE;
+              file_node_new (
+                  node,
+                  same_group_path (group, g_array_index (set, guint, i)),
+                  filetype);
             }
+          flush->nodes = g_slist_prepend (flush->nodes, node);
         }
+      g_ptr_array_free (sets, TRUE);
 
-      if (afind && bfind)
-        {
-          return slist;
-        }
-      else if (afind)
-        {
-          fn = file_node_new (node, bfile, filetype);
+      same_group_free (group);
+    }
+  flush->nodes = g_slist_reverse (flush->nodes);
 
-          gdk_threads_enter ();
-          if (node->show)
-            {
-              path = gtk_tree_row_reference_get_path (node->treerowref);
-              gtk_tree_model_get_iter (GTK_TREE_MODEL (gui->restreestore), itr,
-                                       path);
-              gtk_tree_store_append (gui->restreestore, itrc, itr);
-              file_node_to_tree_iter (fn, gui->restreestore, itrc);
-              gtk_tree_path_free (path);
-            }
-          gdk_threads_leave ();
+  gdk_threads_add_idle ((GSourceFunc)gui_flush_done, flush);
 
-          return slist;
-        }
-      else if (bfind)
-        {
-          fn = file_node_new (node, afile, filetype);
+  return NULL;
+}
 
-          gdk_threads_enter ();
-          if (node->show)
-            {
-              path = gtk_tree_row_reference_get_path (node->treerowref);
-              gtk_tree_model_get_iter (GTK_TREE_MODEL (gui->restreestore), itr,
-                                       path);
-              gtk_tree_store_append (gui->restreestore, itrc, itr);
-              file_node_to_tree_iter (fn, gui->restreestore, itrc);
-              gtk_tree_path_free (path);
-            }
-          gdk_threads_leave ();
+/* in the main loop, the tree is filled once every file node is ready */
+static gboolean
+gui_flush_done (struct gui_flush *flush)
+{
+  gui_t *gui;
+  GSList *cur;
+  int groups[FD_EBOOK + 1];
 
-          return slist;
-        }
+  gui = flush->gui;
+  memset (groups, 0, sizeof groups);
+  for (cur = flush->nodes; cur; cur = g_slist_next (cur))
+    {
+      gui_same_node_to_tree (gui, cur->data);
+      ++groups[((same_node *)cur->data)->type];
     }
+  gui->same_list = g_slist_concat (gui->same_list, flush->nodes);
+  g_free (flush);
+
+  g_message (_ ("find %d groups same images"), groups[FD_IMAGE]);
+  g_message (_ ("find %d groups same videos"), groups[FD_VIDEO]);
+  g_message (_ ("find %d groups same audios"), groups[FD_AUDIO]);
+  g_message (_ ("find %d groups same ebooks"), groups[FD_EBOOK]);
+
+  gtk_tree_view_expand_all (GTK_TREE_VIEW (gui->restree));
+
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (gui->progress), 0);
+  gtk_progress_bar_set_text (GTK_PROGRESS_BAR (gui->progress), "");
 
-  node = g_malloc0 (sizeof (same_node));
-  g_return_val_if_fail (node, slist);
+  /* disable the add/find tool time */
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_add), TRUE);
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_find), TRUE);
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_del), TRUE);
+  gtk_widget_set_sensitive (GTK_WIDGET (gui->but_stop), FALSE);
 
-  node->type = filetype;
-  fn = file_node_new (node, afile, filetype);
-  fn2 = file_node_new (node, bfile, filetype);
+  return FALSE;
+}
+
+/* the first file is the parent row, the others its children */
+static void
+gui_same_node_to_tree (gui_t *gui, same_node *node)
+{
+  GtkTreeIter itr[1], itrc[1];
+  GtkTreePath *path;
+  GSList *filelist;
 
-  gdk_threads_enter ();
   gtk_tree_store_append (gui->restreestore, itr, NULL);
-  file_node_to_tree_iter (fn, gui->restreestore, itr);
+  file_node_to_tree_iter (node->files->data, gui->restreestore, itr);
+
   path = gtk_tree_model_get_path (GTK_TREE_MODEL (gui->restreestore), itr);
   node->treerowref
       = gtk_tree_row_reference_new (GTK_TREE_MODEL (gui->restreestore), path);
   gtk_tree_path_free (path);
-  gtk_tree_store_append (gui->restreestore, itrc, itr);
-  file_node_to_tree_iter (fn2, gui->restreestore, itrc);
-  node->show = TRUE;
-  gdk_threads_leave ();
 
-  return g_slist_append (slist, node);
+  for (filelist = g_slist_next (node->files); filelist != NULL;
+       filelist = g_slist_next (filelist))
+    {
+      gtk_tree_store_append (gui->restreestore, itrc, itr);
+      file_node_to_tree_iter (filelist->data, gui->restreestore, itrc);
+    }
+
+  node->show = TRUE;
 }
 
 void
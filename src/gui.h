@@ -28,6 +28,8 @@
 #ifndef _FDUPVES_GUI_H_
 #define _FDUPVES_GUI_H_
 
+#include "group.h"
+
 #include <gtk/gtk.h>
 
 typedef struct file_node_s file_node;
@@ -36,26 +38,41 @@ struct gui_s
 {
   gboolean quit;
 
+  /* the running find, cancelled by stop and quit */
+  GCancellable *cancel;
+
   GtkWidget *widget;
   GtkWidget *mainvbox;
   GtkWidget *progress;
 
   GtkToolItem *but_add;
   GtkToolItem *but_find;
+  GtkToolItem *but_stop;
   GtkToolItem *but_del;
 
   GtkListStore *dirliststore;
 
-  GPtrArray *images;
-  GPtrArray *videos;
-  GPtrArray *audios;
-  GPtrArray *ebooks;
   GSList *same_images;
   GSList *same_videos;
   GSList *same_audios;
   GSList *same_ebooks;
   GSList *same_list;
 
+  /* pairs of the running find, per file type FD_IMAGE ...,
+   * only touched by the main loop */
+  same_group_t *same_groups[0x10];
+
+  /* progress of the running find: the workers publish it, a timeout of
+   * the main loop shows it */
+  volatile gint step_now;
+  volatile gint step_total;
+  gpointer step_doing;
+  guint step_timer;
+
+  /* pairs found by the workers, handed to the main loop in batches */
+  GMutex found_lock;
+  GPtrArray *found;
+
   GtkWidget *logtree;
   GtkListStore *logliststore;
 
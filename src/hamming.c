@@ -0,0 +1,263 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE hamming.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "find.h"
+#include "hash.h"
+
+#include <glib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FDUPVES_HAMMING_AVX2 1
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define HAMMING_MASK_ALL (~0ULL)
+#define HAMMING_MASK_TOP 0xFFFFFF00ULL
+#define HAMMING_MASK_BOTTOM 0x00FFFFFFULL
+#define HAMMING_MASK_LEFT 0xFCFCFCFCULL
+#define HAMMING_MASK_RIGHT 0x3F3F3F3FULL
+
+#if defined(__GNUC__)
+#define hamming_popcount(c) __builtin_popcountll (c)
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define hamming_popcount(c) ((int)__popcnt64 (c))
+#else
+static int
+hamming_popcount (hash_t c)
+{
+  c = c - ((c >> 1) & 0x5555555555555555ULL);
+  c = (c & 0x3333333333333333ULL) + ((c >> 2) & 0x3333333333333333ULL);
+  c = (c + (c >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (int)((c * 0x0101010101010101ULL) >> 56);
+}
+#endif
+
+int
+hash_bit_count (hash_t c)
+{
+  return hamming_popcount (c);
+}
+
+/* the mask is a literal in every expansion, so the compiler folds it */
+#define HAMMING_SCALAR(name, MASK)                                            \
+  static void name##_distances (hash_t h, const hash_t *hs, gsize n,          \
+                                guint8 *out)                                  \
+  {                                                                           \
+    gsize i;                                                                  \
+                                                                              \
+    for (i = 0; i < n; ++i)                                                   \
+      {                                                                       \
+        out[i] = (h && hs[i]) ? hamming_popcount ((h ^ hs[i]) & (MASK))       \
+                              : FDUPVES_HASH_BITS;                            \
+      }                                                                       \
+  }                                                                           \
+                                                                              \
+  static gsize name##_matches (hash_t h, const hash_t *hs, gsize n,           \
+                               int threshold, guint32 *out)                   \
+  {                                                                           \
+    gsize i, cnt;                                                             \
+                                                                              \
+    if (!h)                                                                   \
+      {                                                                       \
+        return 0;                                                             \
+      }                                                                       \
+                                                                              \
+    for (i = 0, cnt = 0; i < n; ++i)                                          \
+      {                                                                       \
+        out[cnt] = (guint32)i;                                                \
+        cnt += (hs[i] != 0)                                                   \
+               & (hamming_popcount ((h ^ hs[i]) & (MASK)) < threshold);       \
+      }                                                                       \
+                                                                              \
+    return cnt;                                                               \
+  }
+
+HAMMING_SCALAR (hamming_all, HAMMING_MASK_ALL)
+HAMMING_SCALAR (hamming_top, HAMMING_MASK_TOP)
+HAMMING_SCALAR (hamming_bottom, HAMMING_MASK_BOTTOM)
+HAMMING_SCALAR (hamming_left, HAMMING_MASK_LEFT)
+HAMMING_SCALAR (hamming_right, HAMMING_MASK_RIGHT)
+
+static const hash_kernel_t hamming_scalar[] = {
+  { HAMMING_MASK_ALL, hamming_all_distances, hamming_all_matches },
+  { HAMMING_MASK_TOP, hamming_top_distances, hamming_top_matches },
+  { HAMMING_MASK_BOTTOM, hamming_bottom_distances, hamming_bottom_matches },
+  { HAMMING_MASK_LEFT, hamming_left_distances, hamming_left_matches },
+  { HAMMING_MASK_RIGHT, hamming_right_distances, hamming_right_matches },
+};
+
+#ifdef FDUPVES_HAMMING_AVX2
+
+/* per 64 bits lane bit count, nibble lookup + sad */
+__attribute__ ((target ("avx2"))) static inline __m256i
+hamming_popcount_avx2 (__m256i v)
+{
+  const __m256i lookup
+      = _mm256_setr_epi8 (0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0,
+                          1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8 (0x0F);
+  __m256i lo, hi, cnt;
+
+  lo = _mm256_and_si256 (v, low);
+  hi = _mm256_and_si256 (_mm256_srli_epi16 (v, 4), low);
+  cnt = _mm256_add_epi8 (_mm256_shuffle_epi8 (lookup, lo),
+                         _mm256_shuffle_epi8 (lookup, hi));
+
+  return _mm256_sad_epu8 (cnt, _mm256_setzero_si256 ());
+}
+
+__attribute__ ((target ("avx2"))) static inline __m256i
+hamming_lanes_avx2 (__m256i hv, const hash_t *hs, hash_t mask, __m256i *zero)
+{
+  __m256i v;
+
+  v = _mm256_loadu_si256 ((const __m256i *)hs);
+  *zero = _mm256_cmpeq_epi64 (v, _mm256_setzero_si256 ());
+  v = _mm256_and_si256 (_mm256_xor_si256 (hv, v),
+                        _mm256_set1_epi64x ((long long)mask));
+
+  return hamming_popcount_avx2 (v);
+}
+
+#define HAMMING_AVX2(name, MASK)                                              \
+  __attribute__ ((target ("avx2"))) static void name##_distances_avx2 (       \
+      hash_t h, const hash_t *hs, gsize n, guint8 *out)                       \
+  {                                                                           \
+    gsize i;                                                                  \
+    __m256i hv, cnt, zero;                                                    \
+    guint64 lanes[4];                                                         \
+                                                                              \
+    if (!h)                                                                   \
+      {                                                                       \
+        memset (out, FDUPVES_HASH_BITS, n);                                   \
+        return;                                                               \
+      }                                                                       \
+                                                                              \
+    hv = _mm256_set1_epi64x ((long long)h);                                   \
+    for (i = 0; i + 4 <= n; i += 4)                                           \
+      {                                                                       \
+        cnt = hamming_lanes_avx2 (hv, hs + i, (MASK), &zero);                 \
+        cnt = _mm256_blendv_epi8 (                                            \
+            cnt, _mm256_set1_epi64x (FDUPVES_HASH_BITS), zero);               \
+        _mm256_storeu_si256 ((__m256i *)lanes, cnt);                          \
+        out[i] = (guint8)lanes[0];                                            \
+        out[i + 1] = (guint8)lanes[1];                                        \
+        out[i + 2] = (guint8)lanes[2];                                        \
+        out[i + 3] = (guint8)lanes[3];                                        \
+      }                                                                       \
+    name##_distances (h, hs + i, n - i, out + i);                             \
+  }                                                                           \
+                                                                              \
+  __attribute__ ((target ("avx2"))) static gsize name##_matches_avx2 (        \
+      hash_t h, const hash_t *hs, gsize n, int threshold, guint32 *out)       \
+  {                                                                           \
+    gsize i, cnt;                                                             \
+    __m256i hv, tv, dist, zero, hit;                                          \
+    int bits;                                                                 \
+                                                                              \
+    if (!h)                                                                   \
+      {                                                                       \
+        return 0;                                                             \
+      }                                                                       \
+                                                                              \
+    hv = _mm256_set1_epi64x ((long long)h);                                   \
+    tv = _mm256_set1_epi64x (threshold);                                      \
+    for (i = 0, cnt = 0; i + 4 <= n; i += 4)                                  \
+      {                                                                       \
+        dist = hamming_lanes_avx2 (hv, hs + i, (MASK), &zero);                \
+        hit = _mm256_andnot_si256 (zero, _mm256_cmpgt_epi64 (tv, dist));      \
+        bits = _mm256_movemask_pd (_mm256_castsi256_pd (hit));                \
+        while (bits)                                                          \
+          {                                                                   \
+            out[cnt++] = (guint32)(i + __builtin_ctz (bits));                 \
+            bits &= bits - 1;                                                 \
+          }                                                                   \
+      }                                                                       \
+                                                                              \
+    n = name##_matches (h, hs + i, n - i, threshold, out + cnt);              \
+    while (n--)                                                               \
+      {                                                                       \
+        out[cnt++] += (guint32)i;                                             \
+      }                                                                       \
+                                                                              \
+    return cnt;                                                               \
+  }
+
+HAMMING_AVX2 (hamming_all, HAMMING_MASK_ALL)
+HAMMING_AVX2 (hamming_top, HAMMING_MASK_TOP)
+HAMMING_AVX2 (hamming_bottom, HAMMING_MASK_BOTTOM)
+HAMMING_AVX2 (hamming_left, HAMMING_MASK_LEFT)
+HAMMING_AVX2 (hamming_right, HAMMING_MASK_RIGHT)
+
+static const hash_kernel_t hamming_avx2[] = {
+  { HAMMING_MASK_ALL, hamming_all_distances_avx2, hamming_all_matches_avx2 },
+  { HAMMING_MASK_TOP, hamming_top_distances_avx2, hamming_top_matches_avx2 },
+  { HAMMING_MASK_BOTTOM, hamming_bottom_distances_avx2,
+    hamming_bottom_matches_avx2 },
+  { HAMMING_MASK_LEFT, hamming_left_distances_avx2,
+    hamming_left_matches_avx2 },
+  { HAMMING_MASK_RIGHT, hamming_right_distances_avx2,
+    hamming_right_matches_avx2 },
+};
+
+#endif
+
+const hash_kernel_t *
+hash_kernel_get (int area)
+{
+  const hash_kernel_t *kernels;
+
+  kernels = hamming_scalar;
+#ifdef FDUPVES_HAMMING_AVX2
+  if (__builtin_cpu_supports ("avx2"))
+    {
+      kernels = hamming_avx2;
+    }
+#endif
+
+  switch (area)
+    {
+    case FD_COMPARE_TOP:
+      return kernels + 1;
+
+    case FD_COMPARE_BOTTOM:
+      return kernels + 2;
+
+    case FD_COMPARE_LEFT:
+      return kernels + 3;
+
+    case FD_COMPARE_RIGHT:
+      return kernels + 4;
+
+    default:
+      return kernels;
+    }
+}
@@ -35,209 +35,563 @@
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <glib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 const char *hash_phrase[] = {
   "image_hash",
   "image_phash",
   "audio_hash",
+  "image_phash256",
+  "image_sphash",
+  "image_hash_box",
 };
 
-static hash_t pixbuf_hash (GdkPixbuf *);
+/* (r * 30 + g * 59 + b * 11) / 100, the division as a multiply that is
+ * exact for every sum of 8 bit channels */
+#define HASH_GRAY(r, g, b) ((((r) * 30 + (g) * 59 + (b) * 11) * 5243) >> 19)
+
+#define HASH_PIXELS (FDUPVES_HASH_LEN * FDUPVES_HASH_LEN)
+
+/* the cache alg of an image signature */
+#define HASH_SIG_CACHE_ALG(alg)                                               \
+  ((alg) == FDUPVES_IMAGE_HASH ? FDUPVES_IMAGE_HASH_BOX : (alg))
+
+static int hash_sigs_cached (const char *, float, int, hash_t *);
+
+static void hash_sigs_pixels (const guchar *, int, int, int, hash_t *);
+
+static void hash_sigs_store (const char *, float, int, const hash_t *);
 
-#define FDUPVES_HASH_LEN 8
+static void hash_shrink (const guchar *, int, int, int, guchar *);
 
 hash_t
 image_file_hash (const char *file)
+{
+  hash_t hashs[FDUPVES_IMAGE_SIGS];
+
+  image_file_hashes (file,
+                     g_ini->hash_algs | FDUPVES_HASH_ALG (FDUPVES_IMAGE_HASH),
+                     hashs);
+
+  return hashs[FDUPVES_IMAGE_HASH];
+}
+
+int
+image_file_hashes (const char *file, int algs, hash_t *hashs)
 {
   GdkPixbuf *buf;
-  hash_t h;
   GError *err;
+  int len, missing, alg, cnt;
 
-  if (g_cache)
+  missing = hash_sigs_cached (file, 0, algs, hashs);
+  if (missing)
     {
-      if (cache_get (g_cache, file, 0, FDUPVES_IMAGE_HASH, &h))
+      len = FDUPVES_PHASH_LEN;
+      err = NULL;
+      buf = fdupves_gdkpixbuf_load_file_for_hash (file, len, len, &err);
+      if (err)
+        {
+          g_warning ("Load file: %s to pixbuf failed: %s", file,
+                     err->message);
+          g_error_free (err);
+        }
+      else
         {
-          return h;
+          g_assert (gdk_pixbuf_get_colorspace (buf) == GDK_COLORSPACE_RGB);
+          g_assert (gdk_pixbuf_get_bits_per_sample (buf) == 8);
+          g_assert (gdk_pixbuf_get_width (buf) == len
+                    && gdk_pixbuf_get_height (buf) == len);
+
+          hash_sigs_pixels (gdk_pixbuf_get_pixels (buf),
+                            gdk_pixbuf_get_rowstride (buf),
+                            gdk_pixbuf_get_n_channels (buf), missing, hashs);
+          g_object_unref (buf);
+
+          if (g_cache)
+            {
+              cache_begin (g_cache);
+              hash_sigs_store (file, 0, missing, hashs);
+              cache_commit (g_cache);
+            }
         }
     }
 
-  buf = fdupves_gdkpixbuf_load_file_at_size (file, FDUPVES_HASH_LEN,
-                                             FDUPVES_HASH_LEN, &err);
-  if (err)
+  for (alg = 0, cnt = 0; alg < FDUPVES_IMAGE_SIGS; ++alg)
     {
-      g_warning ("Load file: %s to pixbuf failed: %s", file, err->message);
-      g_error_free (err);
-      return 0;
+      cnt += (algs & FDUPVES_HASH_ALG (alg)) && hashs[alg];
     }
 
-  h = pixbuf_hash (buf);
-  g_object_unref (buf);
+  return cnt;
+}
 
-  if (g_cache)
+hash_t
+image_buffer_hash (const char *buffer, int size)
+{
+  g_return_val_if_fail (size >= HASH_PIXELS * 3, 0);
+
+  return hash_pixels ((const guchar *)buffer, FDUPVES_HASH_LEN * 3, 3);
+}
+
+hash_t
+hash_pixels (const guchar *pixels, int rowstride, int channels)
+{
+  guint8 grays[HASH_PIXELS];
+  const guchar *p;
+  int x, y, sum, avg, off;
+  hash_t hash;
+#ifdef __SSE2__
+  __m128i a, g;
+#endif
+
+  /* one case per layout, the inner loops have a constant step */
+  sum = 0;
+  off = 0;
+  for (y = 0; y < FDUPVES_HASH_LEN; ++y)
     {
-      if (h)
+      p = pixels + y * rowstride;
+      switch (channels)
+        {
+        case 3:
+          for (x = 0; x < FDUPVES_HASH_LEN; ++x, p += 3)
+            {
+              grays[off + x] = HASH_GRAY (p[0], p[1], p[2]);
+            }
+          break;
+
+        case 4:
+          for (x = 0; x < FDUPVES_HASH_LEN; ++x, p += 4)
+            {
+              grays[off + x] = HASH_GRAY (p[0], p[1], p[2]);
+            }
+          break;
+
+        default:
+          for (x = 0; x < FDUPVES_HASH_LEN; ++x, p += channels)
+            {
+              grays[off + x] = p[0];
+            }
+          break;
+        }
+
+      for (x = 0; x < FDUPVES_HASH_LEN; ++x)
         {
-          cache_set (g_cache, file, 0, FDUPVES_IMAGE_HASH, h);
+          sum += grays[off + x];
         }
+      off += FDUPVES_HASH_LEN;
     }
+  avg = sum / HASH_PIXELS;
 
-  return h;
+  hash = 0;
+#ifdef __SSE2__
+  /* gray >= avg where max (gray, avg) == gray, 16 bits per movemask */
+  a = _mm_set1_epi8 ((char)avg);
+  for (off = 0; off < HASH_PIXELS; off += 16)
+    {
+      g = _mm_loadu_si128 ((const __m128i *)(grays + off));
+      g = _mm_cmpeq_epi8 (_mm_max_epu8 (g, a), g);
+      hash |= (hash_t)(guint16)_mm_movemask_epi8 (g) << off;
+    }
+#else
+  for (off = 0; off < HASH_PIXELS; ++off)
+    {
+      hash |= (hash_t)(grays[off] >= avg) << off;
+    }
+#endif
+
+  return hash;
 }
 
-hash_t
-image_buffer_hash (const char *buffer, int size)
+void
+hash_pixels_batch (const guchar *pixels, gsize stride, int rowstride,
+                   int channels, gsize count, hash_t *hashs)
 {
-  GdkPixbuf *buf;
-  GError *err;
-  hash_t h;
+  gsize i;
 
-  err = NULL;
-  buf = gdk_pixbuf_new_from_data ((const guchar *)buffer, GDK_COLORSPACE_RGB,
-                                  FALSE, 8, FDUPVES_HASH_LEN, FDUPVES_HASH_LEN,
-                                  FDUPVES_HASH_LEN * 3, NULL, &err);
-  if (err)
+  for (i = 0; i < count; ++i)
     {
-      g_warning ("Load inline data to pixbuf failed: %s", err->message);
-      g_error_free (err);
-      return 0;
+      hashs[i] = hash_pixels (pixels + i * stride, rowstride, channels);
     }
+}
 
-  h = pixbuf_hash (buf);
-  g_object_unref (buf);
+/* every signature of algs found in the cache goes to hashs, the others are
+ * 0 and returned as a mask */
+static int
+hash_sigs_cached (const char *file, float offset, int algs, hash_t *hashs)
+{
+  int alg, missing;
 
-  return h;
+  missing = 0;
+  for (alg = 0; alg < FDUPVES_IMAGE_SIGS; ++alg)
+    {
+      if (!(algs & FDUPVES_HASH_ALG (alg)))
+        {
+          continue;
+        }
+
+      hashs[alg] = 0;
+      if (g_cache
+          && cache_get (g_cache, file, offset, HASH_SIG_CACHE_ALG (alg),
+                        hashs + alg))
+        {
+          continue;
+        }
+      missing |= FDUPVES_HASH_ALG (alg);
+    }
+
+  return missing;
 }
 
-static hash_t
-pixbuf_hash (GdkPixbuf *pixbuf)
+/* a FDUPVES_PHASH_LEN square, the average hash from its box filtered
+ * FDUPVES_HASH_LEN one whatever else algs has */
+static void
+hash_sigs_pixels (const guchar *pixels, int rowstride, int channels,
+                  int algs, hash_t *hashs)
 {
-  int width, height, rowstride, n_channels;
-  guchar *pixels, *p;
-  int *grays, sum, avg, x, y, off;
-  hash_t hash;
+  guchar small[HASH_PIXELS * 3];
 
-  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  if (algs & FDUPVES_HASH_ALG (FDUPVES_IMAGE_HASH))
+    {
+      hash_shrink (pixels, rowstride, channels,
+                   FDUPVES_PHASH_LEN / FDUPVES_HASH_LEN, small);
+      hashs[FDUPVES_IMAGE_HASH]
+          = hash_pixels (small, FDUPVES_HASH_LEN * 3, 3);
+    }
 
-  g_assert (gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB);
-  g_assert (gdk_pixbuf_get_bits_per_sample (pixbuf) == 8);
+  if (algs & FDUPVES_HASH_ALG (FDUPVES_IMAGE_PHASH))
+    {
+      hashs[FDUPVES_IMAGE_PHASH] = hash_pixels_phash (pixels, rowstride,
+                                                      channels);
+    }
+}
 
-  width = gdk_pixbuf_get_width (pixbuf);
-  height = gdk_pixbuf_get_height (pixbuf);
+/* the caller holds a cache transaction */
+static void
+hash_sigs_store (const char *file, float offset, int algs,
+                 const hash_t *hashs)
+{
+  int alg;
 
-  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
-  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  if (g_cache == NULL)
+    {
+      return;
+    }
 
-  grays = g_new0 (int, width *height);
-  off = 0;
-  for (y = 0; y < height; ++y)
+  for (alg = 0; alg < FDUPVES_IMAGE_SIGS; ++alg)
     {
-      for (x = 0; x < width; ++x)
+      if ((algs & FDUPVES_HASH_ALG (alg)) && hashs[alg])
         {
-          p = pixels + y * rowstride + x * n_channels;
-          grays[off] = (p[0] * 30 + p[1] * 59 + p[2] * 11) / 100;
-          ++off;
+          cache_set (g_cache, file, offset, HASH_SIG_CACHE_ALG (alg),
+                     hashs[alg]);
         }
     }
+}
 
-  sum = 0;
-  for (x = 0; x < off; ++x)
-    {
-      sum += grays[x];
-    }
-  avg = sum / off;
+/* box filter of a FDUPVES_HASH_LEN * factor square to a rgb
+ * FDUPVES_HASH_LEN one */
+static void
+hash_shrink (const guchar *pixels, int rowstride, int channels, int factor,
+             guchar *out)
+{
+  const guchar *p;
+  int x, y, c, i, j, sum, n;
 
-  hash = 0;
-  for (x = 0; x < off; ++x)
+  n = factor * factor;
+  for (y = 0; y < FDUPVES_HASH_LEN; ++y)
     {
-      if (grays[x] >= avg)
+      for (x = 0; x < FDUPVES_HASH_LEN; ++x)
         {
-          hash |= ((hash_t)1 << x);
+          for (c = 0; c < 3; ++c)
+            {
+              sum = 0;
+              for (i = 0; i < factor; ++i)
+                {
+                  p = pixels + (y * factor + i) * rowstride
+                      + x * factor * channels + (channels < 3 ? 0 : c);
+                  for (j = 0; j < factor; ++j, p += channels)
+                    {
+                      sum += *p;
+                    }
+                }
+              *out++ = (sum + n / 2) / n;
+            }
         }
     }
+}
 
-  g_free (grays);
-
-  return hash;
+hash_t
+hash_compare_mask (int area)
+{
+  return hash_kernel_get (area)->mask;
 }
 
 int
-hash_cmp (hash_t a, hash_t b)
+hash_distance (hash_t a, hash_t b, hash_t mask)
 {
-  hash_t c;
-  int cmp;
-
   if (!a || !b)
     {
-      return FDUPVES_HASH_LEN * FDUPVES_HASH_LEN; /* max invalid distance */
+      return FDUPVES_HASH_BITS; /* max invalid distance */
     }
 
-  c = a ^ b;
-  switch (g_ini->compare_area)
-    {
-    case FD_COMPARE_TOP:
-      c = c & 0xFFFFFF00ULL;
-      break;
-
-    case FD_COMPARE_BOTTOM:
-      c = c & 0x00FFFFFFULL;
-      break;
+  return hash_bit_count ((a ^ b) & mask);
+}
 
-    case FD_COMPARE_LEFT:
-      c = c & 0xFCFCFCFCULL;
-      break;
+int
+hash256_distance (const hash256_t *a, const hash256_t *b)
+{
+  hash_t ora, orb;
+  int i, dist;
 
-    case FD_COMPARE_RIGHT:
-      c = c & 0x3F3F3F3FULL;
-      break;
+  ora = 0;
+  orb = 0;
+  dist = 0;
+  for (i = 0; i < FDUPVES_HASH256_WORDS; ++i)
+    {
+      ora |= a->words[i];
+      orb |= b->words[i];
+      dist += hash_bit_count (a->words[i] ^ b->words[i]);
+    }
 
-    default:
-      break;
+  if (!ora || !orb)
+    {
+      return -1;
     }
-  for (cmp = 0; c; c = c >> 1)
+
+  return dist;
+}
+
+/* bit u * 8 + v holds the sign of frequency (u, v): a transpose swaps u
+ * and v, a mirror inverts the odd frequencies along its axis */
+void
+hash_sphash_orients (hash_t hash, hash_t *variants)
+{
+  hash_t t, x;
+  int o;
+
+  /* 8x8 bit matrix transpose, the bytes are the rows */
+  x = hash;
+  t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+  x = x ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+  x = x ^ t ^ (t << 14);
+  t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+  x = x ^ t ^ (t << 28);
+
+  for (o = 0; o < FDUPVES_ORIENTS; ++o)
     {
-      if (c & 1)
+      variants[o] = (o & 1) ? x : hash;
+      if (o & 2)
+        {
+          variants[o] ^= 0xAAAAAAAAAAAAAAAAULL;
+        }
+      if (o & 4)
         {
-          ++cmp;
+          variants[o] ^= 0xFF00FF00FF00FF00ULL;
         }
     }
+}
 
-  return cmp;
+int
+hash_cmp (hash_t a, hash_t b)
+{
+  return hash_distance (a, b, hash_compare_mask (g_ini->compare_area));
 }
 
 hash_t
 video_time_hash (const char *file, float offset)
 {
   hash_t h;
-  gchar *buffer;
-  gsize len;
 
-  if (g_cache)
+  video_times_hash (file, &offset, 1, &h);
+
+  return h;
+}
+
+int
+video_times_hash (const char *file, const float *offsets, int count,
+                  hash_t *hashs)
+{
+  hash_t *sigs;
+  int i, cnt;
+
+  sigs = g_new (hash_t, (gsize)count * FDUPVES_IMAGE_SIGS);
+  video_times_hashes (file, offsets, count,
+                      g_ini->hash_algs | FDUPVES_HASH_ALG (FDUPVES_IMAGE_HASH),
+                      sigs);
+
+  for (i = 0, cnt = 0; i < count; ++i)
     {
-      if (cache_get (g_cache, file, offset, FDUPVES_IMAGE_HASH, &h))
-        {
-          return h;
-        }
+      hashs[i] = sigs[i * FDUPVES_IMAGE_SIGS + FDUPVES_IMAGE_HASH];
+      cnt += hashs[i] != 0;
     }
+  g_free (sigs);
 
-  len = FDUPVES_HASH_LEN * FDUPVES_HASH_LEN * 3;
-  buffer = g_malloc (len);
-  g_return_val_if_fail (buffer, 0);
+  return cnt;
+}
 
-  video_time_screenshot (file, offset, FDUPVES_HASH_LEN, FDUPVES_HASH_LEN,
-                         buffer, len);
+int
+video_times_hashes (const char *file, const float *offsets, int count,
+                    int algs, hash_t *hashs)
+{
+  int i, j, k, n, cnt, alg, len, missing, need, *lens;
+  float *times;
+  gchar **buffers, *block;
+  guchar *small;
+  hash_t *frames, *sigs;
+  gsize size;
+
+  /* the offsets not cached yet, ascending and each once; they are the
+   * cache keys as well, so they are not rounded */
+  times = g_new (float, count);
+  n = 0;
+  missing = 0;
+  for (i = 0; i < count; ++i)
+    {
+      need = hash_sigs_cached (file, offsets[i], algs,
+                               hashs + i * FDUPVES_IMAGE_SIGS);
+      if (need == 0)
+        {
+          continue;
+        }
+      missing |= need;
 
-  h = image_buffer_hash (buffer, len);
-  g_free (buffer);
+      for (j = 0; j < n && times[j] < offsets[i]; ++j)
+        ;
+      if (j < n && times[j] == offsets[i])
+        {
+          continue;
+        }
+      for (k = n++; k > j; --k)
+        {
+          times[k] = times[k - 1];
+        }
+      times[j] = offsets[i];
+    }
 
-  if (g_cache)
+  if (n > 0)
     {
-      if (h)
+      len = FDUPVES_PHASH_LEN;
+
+      /* the screenshots side by side in one block */
+      size = (gsize)len * len * 3;
+      block = g_malloc0 (size * n);
+      buffers = g_new (gchar *, n);
+      lens = g_new (int, n);
+      frames = g_new0 (hash_t, (gsize)n * FDUPVES_IMAGE_SIGS);
+      for (j = 0; j < n; ++j)
         {
-          cache_set (g_cache, file, offset, FDUPVES_IMAGE_HASH, h);
+          buffers[j] = block + size * j;
         }
+
+      video_times_screenshot (file, times, n, len, len, buffers, size, lens);
+      if (missing & FDUPVES_HASH_ALG (FDUPVES_IMAGE_HASH))
+        {
+          /* the shrunk screenshots side by side, all of their average
+           * hashes in one call */
+          small = g_new (guchar, (gsize)HASH_PIXELS * 3 * n);
+          sigs = g_new (hash_t, n);
+          for (j = 0; j < n; ++j)
+            {
+              hash_shrink ((const guchar *)buffers[j], len * 3, 3,
+                           len / FDUPVES_HASH_LEN,
+                           small + HASH_PIXELS * 3 * j);
+            }
+          hash_pixels_batch (small, HASH_PIXELS * 3, FDUPVES_HASH_LEN * 3, 3,
+                             n, sigs);
+          for (j = 0; j < n; ++j)
+            {
+              frames[j * FDUPVES_IMAGE_SIGS + FDUPVES_IMAGE_HASH] = sigs[j];
+            }
+          g_free (sigs);
+          g_free (small);
+        }
+      if (missing & FDUPVES_HASH_ALG (FDUPVES_IMAGE_PHASH))
+        {
+          for (j = 0; j < n; ++j)
+            {
+              frames[j * FDUPVES_IMAGE_SIGS + FDUPVES_IMAGE_PHASH]
+                  = hash_pixels_phash ((const guchar *)buffers[j], len * 3,
+                                       3);
+            }
+        }
+
+      if (g_cache)
+        {
+          cache_begin (g_cache);
+        }
+      for (i = 0; i < count; ++i)
+        {
+          sigs = hashs + i * FDUPVES_IMAGE_SIGS;
+
+          /* a hash still 0 was not cached, so its offset was decoded */
+          need = 0;
+          for (alg = 0; alg < FDUPVES_IMAGE_SIGS; ++alg)
+            {
+              if ((algs & FDUPVES_HASH_ALG (alg)) && sigs[alg] == 0)
+                {
+                  need |= FDUPVES_HASH_ALG (alg);
+                }
+            }
+          if (need == 0)
+            {
+              continue;
+            }
+
+          for (j = 0; times[j] != offsets[i]; ++j)
+            ;
+          if (lens[j] < 0)
+            {
+              continue;
+            }
+
+          for (alg = 0; alg < FDUPVES_IMAGE_SIGS; ++alg)
+            {
+              if (need & FDUPVES_HASH_ALG (alg))
+                {
+                  sigs[alg] = frames[j * FDUPVES_IMAGE_SIGS + alg];
+                }
+            }
+          hash_sigs_store (file, offsets[i], need, sigs);
+        }
+      if (g_cache)
+        {
+          cache_commit (g_cache);
+        }
+
+      g_free (block);
+      g_free (buffers);
+      g_free (lens);
+      g_free (frames);
     }
+  g_free (times);
 
-  return h;
+  for (i = 0, cnt = 0; i < count * FDUPVES_IMAGE_SIGS; ++i)
+    {
+      cnt += (algs & FDUPVES_HASH_ALG (i % FDUPVES_IMAGE_SIGS)) && hashs[i];
+    }
+
+  return cnt;
+}
+
+int
+video_frames_hash (const char *file, float length, int count, hash_t *hashs)
+{
+  float *offsets;
+  int i, cnt;
+
+  offsets = g_new (float, count);
+  for (i = 0; i < count; ++i)
+    {
+      offsets[i] = length * (i + 1) / (count + 1);
+    }
+
+  cnt = video_times_hash (file, offsets, count, hashs);
+  g_free (offsets);
+
+  return cnt;
 }
 
 hash_array_t *
@@ -272,19 +626,17 @@ audio_hashes (const char *path)
 }
 
 hash_array_t *
-hash_array_new ()
+hash_array_new (int type, gsize size)
 {
   hash_array_t *hashArray;
 
+  g_return_val_if_fail (size > 0, NULL);
+
   hashArray = g_new0 (hash_array_t, 1);
   g_return_val_if_fail (hashArray, NULL);
 
-  hashArray->array = g_ptr_array_new_with_free_func (g_free);
-  if (hashArray->array == NULL)
-    {
-      g_free (hashArray);
-      return NULL;
-    }
+  hashArray->type = type;
+  hashArray->size = size;
 
   return hashArray;
 }
@@ -292,28 +644,51 @@ hash_array_new ()
 void
 hash_array_free (hash_array_t *hashArray)
 {
-  g_ptr_array_free (hashArray->array, TRUE);
+  g_free (hashArray->data);
   g_free (hashArray);
 }
 
 gsize
 hash_array_size (hash_array_t *hashArray)
 {
-  return hashArray->array->len;
+  return hashArray->len;
+}
+
+void
+hash_array_reserve (hash_array_t *hashArray, gsize count)
+{
+  gsize alloc;
+
+  if (hashArray->len + count <= hashArray->alloc)
+    {
+      return;
+    }
+
+  /* doubling keeps a long run of appends linear */
+  alloc = MAX (hashArray->alloc * 2, 0x100);
+  alloc = MAX (alloc, hashArray->len + count);
+  hashArray->data = g_realloc_n (hashArray->data, alloc, hashArray->size);
+  hashArray->alloc = alloc;
 }
 
 void *
-hash_array_index (hash_array_t *hashArray, int index)
+hash_array_index (hash_array_t *hashArray, gsize index)
+{
+  return hashArray->data + index * hashArray->size;
+}
+
+void
+hash_array_append (hash_array_t *hashArray, const void *hash)
 {
-  void *hashp = g_ptr_array_index (hashArray->array, index);
-  return hashp;
+  hash_array_append_vals (hashArray, hash, 1);
 }
 
 void
-hash_array_append (hash_array_t *hashArray, void *hash, size_t size)
+hash_array_append_vals (hash_array_t *hashArray, const void *hashs,
+                        gsize count)
 {
-  hash_t *nhash = g_malloc (size);
-  g_return_if_fail (nhash);
-  memcpy (nhash, hash, size);
-  g_ptr_array_add (hashArray->array, nhash);
+  hash_array_reserve (hashArray, count);
+  memcpy (hashArray->data + hashArray->len * hashArray->size, hashs,
+          count * hashArray->size);
+  hashArray->len += count;
 }
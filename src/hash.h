@@ -34,39 +34,160 @@ enum hash_type
   FDUPVES_IMAGE_HASH,
   FDUPVES_IMAGE_PHASH,
   FDUPVES_AUDIO_HASH,
+  FDUPVES_IMAGE_PHASH256,
+  FDUPVES_IMAGE_SPHASH,
+  FDUPVES_IMAGE_HASH_BOX,
   FDUPVES_HASH_ALGS_CNT,
 };
 extern const char *hash_phrase[];
 
 typedef unsigned long long hash_t;
 
+#define FDUPVES_HASH_BITS 64
+
+/* the larger signature verifying the candidates of hash_t */
+#define FDUPVES_HASH256_WORDS 4
+#define FDUPVES_HASH256_BITS (FDUPVES_HASH256_WORDS * FDUPVES_HASH_BITS)
+
+typedef struct
+{
+  hash_t words[FDUPVES_HASH256_WORDS];
+} hash256_t;
+
+/* side of the square an average hash is taken from */
+#define FDUPVES_HASH_LEN 8
+
+/* side of the square a perceptual hash is taken from */
+#define FDUPVES_PHASH_LEN 32
+
+/* the image signatures, FDUPVES_IMAGE_HASH and FDUPVES_IMAGE_PHASH, as
+ * bits of an algs mask and as indexes of a hash_t array; all of them come
+ * from one FDUPVES_PHASH_LEN square, the average hash box filtered from
+ * it and cached as FDUPVES_IMAGE_HASH_BOX, apart from the hashes of
+ * older caches */
+#define FDUPVES_IMAGE_SIGS (FDUPVES_IMAGE_PHASH + 1)
+#define FDUPVES_HASH_ALG(alg) (1 << (alg))
+
+/* the rotations and mirrors of an image, as bits of an orient: it is
+ * transposed (1), then mirrored left to right (2), then top to bottom (4) */
+#define FDUPVES_ORIENTS 8
+
+/* a growable run of fixed size records, one block for all of them:
+ * type is the FDUPVES_*_HASH the records belong to */
 typedef struct
 {
-  GPtrArray *array;
+  int type;
+  gsize size;
+  gsize len;
+  gsize alloc;
+  guint8 *data;
 } hash_array_t;
 
 hash_t image_file_hash (const char *);
 
 hash_t image_buffer_hash (const char *, int);
 
+/* average hash of a FDUPVES_HASH_LEN square of 8 bit pixels, 1 (luma),
+ * 3 (rgb) or 4 (rgba) channels; nothing is allocated */
+hash_t hash_pixels (const guchar *pixels, int rowstride, int channels);
+
+/* count squares of the same layout, the i-th at pixels + i * stride */
+void hash_pixels_batch (const guchar *pixels, gsize stride, int rowstride,
+                        int channels, gsize count, hash_t *hashs);
+
+/* perceptual hash of a FDUPVES_PHASH_LEN square, the same layouts */
+hash_t hash_pixels_phash (const guchar *pixels, int rowstride, int channels);
+
 hash_t video_time_hash (const char *, float);
 
+/* the hashes at every offset, decoded in one pass over the file;
+ * returns the count of valid hashes */
+int video_times_hash (const char *, const float *, int, hash_t *);
+
+/* the signature of a video: count frames evenly spaced over its length */
+int video_frames_hash (const char *, float, int, hash_t *);
+
 hash_t video_time_phash (const char *, float);
 
 hash_t image_file_phash (const char *);
 
+/* 16x16 low frequencies of the 32x32 DCT against their median,
+ * computed on demand and cached; FALSE when the file fails to load */
+gboolean image_file_phash256 (const char *, hash256_t *);
+
+/* the FDUPVES_HASH256_BITS low frequencies image_file_phash256
+ * thresholds, row by row; FALSE when the file fails to load */
+gboolean image_file_dct256 (const char *, gdouble *coeffs);
+
+/* image_file_phash256 of the image turned by orient, from its
+ * image_file_dct256: a turn transposes the frequencies and a mirror
+ * inverts the odd ones along its axis */
+void hash_dct256_orient (const gdouble *coeffs, int orient, hash256_t *);
+
+/* signs of the 8x8 lowest frequencies of the 32x32 DCT, a turned image
+ * only permutes and inverts them; computed on demand and cached */
+hash_t image_file_sphash (const char *);
+
+/* the image_file_sphash of the image turned by every orient, from the
+ * hash alone */
+void hash_sphash_orients (hash_t, hash_t *variants);
+
+/* every signature in algs from one decode of the file into hashs[alg],
+ * cached together; returns the count of valid ones */
+int image_file_hashes (const char *, int algs, hash_t *hashs);
+
+/* the same for the frame at every offset, in
+ * hashs[i * FDUPVES_IMAGE_SIGS + alg] */
+int video_times_hashes (const char *, const float *, int count, int algs,
+                        hash_t *hashs);
+
 hash_array_t *audio_hashes (const char *);
 
 int hash_cmp (hash_t, hash_t);
 
-hash_array_t *hash_array_new ();
+hash_t hash_compare_mask (int);
+
+int hash_bit_count (hash_t);
+
+int hash_distance (hash_t, hash_t, hash_t);
+
+/* -1 when either is invalid, all 0: unlike hash_distance, every distance
+ * up to FDUPVES_HASH256_BITS is a real one */
+int hash256_distance (const hash256_t *, const hash256_t *);
+
+/* batch hamming kernels, the mask of a compare area is built in */
+typedef struct
+{
+  hash_t mask;
+
+  /* distance of the hash to every element, invalid pairs get
+   * FDUPVES_HASH_BITS */
+  void (*distances) (hash_t, const hash_t *, gsize, guint8 *);
+
+  /* indexes of elements with distance < threshold, the output must hold
+   * count entries */
+  gsize (*matches) (hash_t, const hash_t *, gsize, int, guint32 *);
+} hash_kernel_t;
+
+const hash_kernel_t *hash_kernel_get (int area);
+
+hash_array_t *hash_array_new (int type, gsize size);
 
 void hash_array_free (hash_array_t *hashArray);
 
 gsize hash_array_size (hash_array_t *hashArray);
 
-void *hash_array_index (hash_array_t *hashArray, int index);
+/* room for count more records without moving the block */
+void hash_array_reserve (hash_array_t *hashArray, gsize count);
+
+void *hash_array_index (hash_array_t *hashArray, gsize index);
+
+/* the records one after another, hash_array_size of them */
+#define hash_array_data(a) ((gpointer)(a)->data)
+
+void hash_array_append (hash_array_t *hashArray, const void *hash);
 
-void hash_array_append (hash_array_t *hashArray, void *hash, size_t size);
+void hash_array_append_vals (hash_array_t *hashArray, const void *hashs,
+                             gsize count);
 
 #endif
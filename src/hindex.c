@@ -0,0 +1,404 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE hindex.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "hindex.h"
+
+#include <glib.h>
+#include <string.h>
+
+#ifndef FDUPVES_HINDEX_SLOTS
+#define FDUPVES_HINDEX_SLOTS 256
+#endif
+
+#define HINDEX_EMPTY (-1)
+
+struct hash_index_chunk
+{
+  hash_t mask;
+  int bits[FDUPVES_HASH_BITS];
+  int nbits;
+
+  /* open addressing table: substring -> last inserted id */
+  guint64 *keys;
+  gint32 *heads;
+  gsize nslots;
+  gsize used;
+};
+
+struct hash_index_s
+{
+  hash_t mask;
+
+  /* a hash matches when its distance < distance */
+  int distance;
+
+  /* every substring is probed up to this distance */
+  int radius;
+
+  int nchunks;
+  struct hash_index_chunk *chunks;
+
+  /* hash_t of every id */
+  GArray *hashs;
+
+  /* per id and chunk, the previous id in the same bucket */
+  GArray *next;
+};
+
+struct hash_index_probe
+{
+  hash_index_t *index;
+  int chunk;
+  hash_t hash;
+  guint lo;
+  guint hi;
+  hash_index_func func;
+  gpointer arg;
+};
+
+static void hash_index_chunk_init (struct hash_index_chunk *, gsize);
+
+static gsize hash_index_slot (struct hash_index_chunk *, guint64);
+
+static void hash_index_chunk_grow (struct hash_index_chunk *);
+
+static void hash_index_probe_key (struct hash_index_probe *, guint64, int,
+                                  int);
+
+static void hash_index_walk (struct hash_index_probe *, guint64);
+
+hash_index_t *
+hash_index_new (hash_t mask, int distance, gsize hint)
+{
+  hash_index_t *index;
+  int bitcnt, radius, lg, m, c, i, b, start, end;
+  int positions[FDUPVES_HASH_BITS];
+
+  index = g_new0 (hash_index_t, 1);
+  g_return_val_if_fail (index, NULL);
+
+  index->mask = mask;
+  index->distance = distance;
+  index->hashs = g_array_new (FALSE, FALSE, sizeof (hash_t));
+
+  bitcnt = 0;
+  for (b = 0; b < FDUPVES_HASH_BITS; ++b)
+    {
+      if (mask & ((hash_t)1 << b))
+        {
+          positions[bitcnt++] = b;
+        }
+    }
+
+  if (distance <= 0)
+    {
+      /* nothing can match */
+      index->nchunks = 0;
+    }
+  else if (distance - 1 >= bitcnt)
+    {
+      /* every valid hash matches, one bucket holds them all */
+      index->nchunks = 1;
+      index->radius = 0;
+    }
+  else
+    {
+      radius = distance - 1;
+
+      /* substrings about log2(n) bits wide keep buckets near one entry */
+      for (lg = 1; lg < FDUPVES_HASH_BITS && ((gsize)1 << lg) < hint; ++lg)
+        ;
+      m = (bitcnt + lg / 2) / lg;
+      m = CLAMP (m, 1, radius + 1);
+
+      index->nchunks = m;
+      index->radius = radius / m;
+    }
+
+  index->chunks = g_new0 (struct hash_index_chunk, MAX (index->nchunks, 1));
+  index->next = g_array_new (FALSE, FALSE, sizeof (gint32));
+
+  for (c = 0; c < index->nchunks; ++c)
+    {
+      hash_index_chunk_init (index->chunks + c, FDUPVES_HINDEX_SLOTS);
+      if (distance - 1 >= bitcnt)
+        {
+          continue;
+        }
+
+      start = c * bitcnt / index->nchunks;
+      end = (c + 1) * bitcnt / index->nchunks;
+      for (i = start; i < end; ++i)
+        {
+          b = positions[i];
+          index->chunks[c].mask |= (hash_t)1 << b;
+          index->chunks[c].bits[index->chunks[c].nbits++] = b;
+        }
+    }
+
+  return index;
+}
+
+void
+hash_index_free (hash_index_t *index)
+{
+  int c;
+
+  for (c = 0; c < index->nchunks; ++c)
+    {
+      g_free (index->chunks[c].keys);
+      g_free (index->chunks[c].heads);
+    }
+  g_free (index->chunks);
+  g_array_free (index->hashs, TRUE);
+  g_array_free (index->next, TRUE);
+  g_free (index);
+}
+
+guint
+hash_index_insert (hash_index_t *index, hash_t hash)
+{
+  guint id;
+  int c;
+  gint32 none;
+  gsize slot;
+  struct hash_index_chunk *chunk;
+
+  id = index->hashs->len;
+  g_array_append_val (index->hashs, hash);
+
+  none = HINDEX_EMPTY;
+  for (c = 0; c < index->nchunks; ++c)
+    {
+      g_array_append_val (index->next, none);
+    }
+
+  /* invalid hash never matches anything */
+  if (hash == 0)
+    {
+      return id;
+    }
+
+  for (c = 0; c < index->nchunks; ++c)
+    {
+      chunk = index->chunks + c;
+      if ((chunk->used + 1) * 2 > chunk->nslots)
+        {
+          hash_index_chunk_grow (chunk);
+        }
+
+      slot = hash_index_slot (chunk, hash & chunk->mask);
+      if (chunk->heads[slot] == HINDEX_EMPTY)
+        {
+          chunk->keys[slot] = hash & chunk->mask;
+          ++chunk->used;
+        }
+
+      g_array_index (index->next, gint32, id * index->nchunks + c)
+          = chunk->heads[slot];
+      chunk->heads[slot] = (gint32)id;
+    }
+
+  return id;
+}
+
+gsize
+hash_index_size (hash_index_t *index)
+{
+  return index->hashs->len;
+}
+
+hash_t
+hash_index_get (hash_index_t *index, guint id)
+{
+  return g_array_index (index->hashs, hash_t, id);
+}
+
+void
+hash_index_query (hash_index_t *index, hash_t hash, hash_index_func func,
+                  gpointer arg)
+{
+  hash_index_query_range (index, hash, 0, G_MAXUINT, func, arg);
+}
+
+void
+hash_index_query_range (hash_index_t *index, hash_t hash, guint lo, guint hi,
+                        hash_index_func func, gpointer arg)
+{
+  struct hash_index_probe probe[1];
+  int c;
+
+  if (hash == 0 || lo >= hi)
+    {
+      return;
+    }
+
+  probe->index = index;
+  probe->hash = hash;
+  probe->lo = lo;
+  probe->hi = hi;
+  probe->func = func;
+  probe->arg = arg;
+
+  for (c = 0; c < index->nchunks; ++c)
+    {
+      probe->chunk = c;
+      hash_index_probe_key (probe, hash & index->chunks[c].mask, 0,
+                            index->radius);
+    }
+}
+
+static void
+hash_index_chunk_init (struct hash_index_chunk *chunk, gsize nslots)
+{
+  gsize i;
+
+  chunk->nslots = nslots;
+  chunk->used = 0;
+  chunk->keys = g_new (guint64, nslots);
+  chunk->heads = g_new (gint32, nslots);
+  for (i = 0; i < nslots; ++i)
+    {
+      chunk->heads[i] = HINDEX_EMPTY;
+    }
+}
+
+static gsize
+hash_index_slot (struct hash_index_chunk *chunk, guint64 key)
+{
+  gsize slot;
+
+  slot = (gsize)((key * 0x9E3779B97F4A7C15ULL) >> 17) & (chunk->nslots - 1);
+  while (chunk->heads[slot] != HINDEX_EMPTY && chunk->keys[slot] != key)
+    {
+      slot = (slot + 1) & (chunk->nslots - 1);
+    }
+
+  return slot;
+}
+
+static void
+hash_index_chunk_grow (struct hash_index_chunk *chunk)
+{
+  guint64 *keys;
+  gint32 *heads;
+  gsize i, nslots, slot;
+
+  keys = chunk->keys;
+  heads = chunk->heads;
+  nslots = chunk->nslots;
+
+  hash_index_chunk_init (chunk, nslots * 2);
+  for (i = 0; i < nslots; ++i)
+    {
+      if (heads[i] == HINDEX_EMPTY)
+        {
+          continue;
+        }
+
+      slot = hash_index_slot (chunk, keys[i]);
+      chunk->keys[slot] = keys[i];
+      chunk->heads[slot] = heads[i];
+      ++chunk->used;
+    }
+
+  g_free (keys);
+  g_free (heads);
+}
+
+/* visit every substring within 'left' flipped bits of key */
+static void
+hash_index_probe_key (struct hash_index_probe *probe, guint64 key, int from,
+                      int left)
+{
+  struct hash_index_chunk *chunk;
+  int i;
+
+  hash_index_walk (probe, key);
+  if (left == 0)
+    {
+      return;
+    }
+
+  chunk = probe->index->chunks + probe->chunk;
+  for (i = from; i < chunk->nbits; ++i)
+    {
+      hash_index_probe_key (probe, key ^ ((hash_t)1 << chunk->bits[i]), i + 1,
+                            left - 1);
+    }
+}
+
+static void
+hash_index_walk (struct hash_index_probe *probe, guint64 key)
+{
+  hash_index_t *index;
+  struct hash_index_chunk *chunk;
+  gsize slot;
+  gint32 id;
+  hash_t other;
+  int c, dist;
+
+  index = probe->index;
+  chunk = index->chunks + probe->chunk;
+
+  /* a bucket chains its ids from the newest down */
+  slot = hash_index_slot (chunk, key);
+  for (id = chunk->heads[slot]; id != HINDEX_EMPTY;
+       id = g_array_index (index->next, gint32,
+                           id * index->nchunks + probe->chunk))
+    {
+      if ((guint)id >= probe->hi)
+        {
+          continue;
+        }
+      if ((guint)id < probe->lo)
+        {
+          break;
+        }
+
+      other = g_array_index (index->hashs, hash_t, id);
+
+      /* report every id only from the first substring that finds it */
+      for (c = 0; c < probe->chunk; ++c)
+        {
+          if (hash_bit_count ((probe->hash ^ other) & index->chunks[c].mask)
+              <= index->radius)
+            {
+              break;
+            }
+        }
+      if (c < probe->chunk)
+        {
+          continue;
+        }
+
+      dist = hash_distance (probe->hash, other, index->mask);
+      if (dist < index->distance)
+        {
+          probe->func ((guint)id, dist, probe->arg);
+        }
+    }
+}
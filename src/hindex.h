@@ -0,0 +1,60 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE hindex.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_HINDEX_H_
+#define _FDUPVES_HINDEX_H_
+
+#include "hash.h"
+
+#include <glib.h>
+
+/* multi-index hashing over hash_t:
+ * the masked bits are split into substrings, a query only visits the
+ * buckets whose substring is close enough that the pigeonhole principle
+ * still guarantees every hash with distance < 'distance' is found.
+ */
+typedef struct hash_index_s hash_index_t;
+
+typedef void (*hash_index_func) (guint id, int dist, gpointer);
+
+hash_index_t *hash_index_new (hash_t mask, int distance, gsize hint);
+
+void hash_index_free (hash_index_t *);
+
+guint hash_index_insert (hash_index_t *, hash_t);
+
+gsize hash_index_size (hash_index_t *);
+
+hash_t hash_index_get (hash_index_t *, guint id);
+
+void hash_index_query (hash_index_t *, hash_t, hash_index_func, gpointer);
+
+/* the same, only the ids from lo and below hi; the ids out of the range
+ * cost nothing once the newer ones are skipped */
+void hash_index_query_range (hash_index_t *, hash_t, guint lo, guint hi,
+                             hash_index_func, gpointer);
+
+#endif
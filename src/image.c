@@ -25,11 +25,39 @@
  */
 
 #include "image.h"
+#include "ini.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
 
 #ifdef WIN32
 #include "image-win.h"
 #endif
 
+#ifdef FDUPVES_HAVE_JPEG
+#include <setjmp.h>
+#include <stdio.h>
+#include <jpeglib.h>
+
+struct image_jpeg_error
+{
+  struct jpeg_error_mgr mgr;
+  jmp_buf jmp;
+};
+
+static GdkPixbuf *image_jpeg_load (struct jpeg_decompress_struct *, int,
+                                   int);
+
+static GdkPixbuf *image_jpeg_thumbnail (struct jpeg_decompress_struct *,
+                                        int, int);
+
+static const guchar *image_exif_thumbnail (const guchar *, gsize, gsize *);
+
+static void image_jpeg_error_exit (j_common_ptr);
+
+static void image_jpeg_silent (j_common_ptr);
+#endif
+
 GdkPixbuf *
 fdupves_gdkpixbuf_load_file_at_size (const gchar *file, int w, int h,
                                      GError **error)
@@ -66,3 +94,285 @@ fdupves_gdkpixbuf_load_file_at_size (const gchar *file, int w, int h,
 
   return buf;
 }
+
+GdkPixbuf *
+fdupves_gdkpixbuf_load_file_for_hash (const gchar *file, int w, int h,
+                                      GError **error)
+{
+#ifdef FDUPVES_HAVE_JPEG
+  struct jpeg_decompress_struct cinfo[1];
+  struct image_jpeg_error jerr[1];
+  GdkPixbuf *volatile buf;
+  FILE *fp;
+
+  if (error)
+    {
+      *error = NULL;
+    }
+
+  fp = g_fopen (file, "rb");
+  if (fp == NULL)
+    {
+      return fdupves_gdkpixbuf_load_file_at_size (file, w, h, error);
+    }
+
+  buf = NULL;
+  cinfo->err = jpeg_std_error (&jerr->mgr);
+  cinfo->client_data = NULL;
+  jerr->mgr.error_exit = image_jpeg_error_exit;
+  jerr->mgr.output_message = image_jpeg_silent;
+  jpeg_create_decompress (cinfo);
+
+  /* not a jpeg, or a broken one: gdk-pixbuf tells why */
+  if (setjmp (jerr->jmp) == 0)
+    {
+      jpeg_stdio_src (cinfo, fp);
+      if (g_ini->image_thumbnail)
+        {
+          jpeg_save_markers (cinfo, JPEG_APP0 + 1, 0xFFFF);
+        }
+
+      jpeg_read_header (cinfo, TRUE);
+      if (g_ini->image_thumbnail)
+        {
+          buf = image_jpeg_thumbnail (cinfo, w, h);
+        }
+      if (buf == NULL)
+        {
+          buf = image_jpeg_load (cinfo, w, h);
+        }
+    }
+  else
+    {
+      /* the pixbuf image_jpeg_load was filling */
+      if (cinfo->client_data)
+        {
+          g_object_unref (cinfo->client_data);
+        }
+      buf = NULL;
+    }
+  jpeg_destroy_decompress (cinfo);
+  fclose (fp);
+
+  if (buf)
+    {
+      return buf;
+    }
+#endif
+
+  return fdupves_gdkpixbuf_load_file_at_size (file, w, h, error);
+}
+
+#ifdef FDUPVES_HAVE_JPEG
+/* cinfo has its header read, libjpeg errors jump to the caller */
+static GdkPixbuf *
+image_jpeg_load (struct jpeg_decompress_struct *cinfo, int w, int h)
+{
+  GdkPixbuf *full, *buf;
+  guchar *pixels;
+  JSAMPROW row;
+  int rowstride, denom;
+
+  /* libjpeg does not turn these into rgb */
+  if (cinfo->jpeg_color_space == JCS_CMYK
+      || cinfo->jpeg_color_space == JCS_YCCK)
+    {
+      return NULL;
+    }
+
+  /* the inverse DCT of 1/8 scale is the DC term alone */
+  for (denom = 8; denom > 1; denom /= 2)
+    {
+      if ((cinfo->image_width + denom - 1) / denom >= (JDIMENSION)w
+          && (cinfo->image_height + denom - 1) / denom >= (JDIMENSION)h)
+        {
+          break;
+        }
+    }
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = denom;
+  cinfo->out_color_space = JCS_RGB;
+  cinfo->dct_method = JDCT_IFAST;
+  cinfo->do_fancy_upsampling = FALSE;
+
+  jpeg_start_decompress (cinfo);
+  full = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, cinfo->output_width,
+                         cinfo->output_height);
+  if (full == NULL)
+    {
+      jpeg_abort_decompress (cinfo);
+      return NULL;
+    }
+  cinfo->client_data = full;
+
+  pixels = gdk_pixbuf_get_pixels (full);
+  rowstride = gdk_pixbuf_get_rowstride (full);
+  while (cinfo->output_scanline < cinfo->output_height)
+    {
+      row = pixels + (gsize)cinfo->output_scanline * rowstride;
+      jpeg_read_scanlines (cinfo, &row, 1);
+    }
+  jpeg_finish_decompress (cinfo);
+  cinfo->client_data = NULL;
+
+  /* the same filter gdk_pixbuf_new_from_file_at_scale ends with */
+  buf = gdk_pixbuf_scale_simple (full, w, h, GDK_INTERP_BILINEAR);
+  g_object_unref (full);
+
+  return buf;
+}
+
+static GdkPixbuf *
+image_jpeg_thumbnail (struct jpeg_decompress_struct *cinfo, int w, int h)
+{
+  struct jpeg_decompress_struct tinfo[1];
+  struct image_jpeg_error jerr[1];
+  jpeg_saved_marker_ptr marker;
+  const guchar *thumb;
+  GdkPixbuf *volatile buf;
+  gsize len;
+
+  thumb = NULL;
+  for (marker = cinfo->marker_list; marker && thumb == NULL;
+       marker = marker->next)
+    {
+      if (marker->marker == JPEG_APP0 + 1)
+        {
+          thumb = image_exif_thumbnail (marker->data, marker->data_length,
+                                        &len);
+        }
+    }
+  if (thumb == NULL)
+    {
+      return NULL;
+    }
+
+  buf = NULL;
+  tinfo->err = jpeg_std_error (&jerr->mgr);
+  tinfo->client_data = NULL;
+  jerr->mgr.error_exit = image_jpeg_error_exit;
+  jerr->mgr.output_message = image_jpeg_silent;
+  jpeg_create_decompress (tinfo);
+  if (setjmp (jerr->jmp) == 0)
+    {
+      jpeg_mem_src (tinfo, (unsigned char *)thumb, len);
+      jpeg_read_header (tinfo, TRUE);
+
+      /* a thumbnail of another shape is letterboxed, the image is not:
+       * its height is within a pixel of the image scaled to its width */
+      if (tinfo->image_width >= (JDIMENSION)w
+          && tinfo->image_height >= (JDIMENSION)h
+          && ABS ((gint64)tinfo->image_width * cinfo->image_height
+                  - (gint64)tinfo->image_height * cinfo->image_width)
+                 <= (gint64)cinfo->image_width)
+        {
+          buf = image_jpeg_load (tinfo, w, h);
+        }
+    }
+  else
+    {
+      if (tinfo->client_data)
+        {
+          g_object_unref (tinfo->client_data);
+        }
+      buf = NULL;
+    }
+  jpeg_destroy_decompress (tinfo);
+
+  return buf;
+}
+
+#define IMAGE_EXIF_U16(p)                                                     \
+  (big ? ((p)[0] << 8 | (p)[1]) : ((p)[1] << 8 | (p)[0]))
+#define IMAGE_EXIF_U32(p)                                                     \
+  (big ? ((guint32)(p)[0] << 24 | (p)[1] << 16 | (p)[2] << 8 | (p)[3])       \
+       : ((guint32)(p)[3] << 24 | (p)[2] << 16 | (p)[1] << 8 | (p)[0]))
+
+/* the jpeg thumbnail of IFD1 in an APP1 Exif segment, inside data */
+static const guchar *
+image_exif_thumbnail (const guchar *data, gsize len, gsize *thumb_len)
+{
+  const guchar *tiff, *entry;
+  gsize size, ifd, n, i, offset, length;
+  gboolean big;
+  guint tag;
+
+  if (len < 14 || memcmp (data, "Exif\0\0", 6) != 0)
+    {
+      return NULL;
+    }
+  tiff = data + 6;
+  size = len - 6;
+
+  if (memcmp (tiff, "MM", 2) == 0)
+    {
+      big = TRUE;
+    }
+  else if (memcmp (tiff, "II", 2) == 0)
+    {
+      big = FALSE;
+    }
+  else
+    {
+      return NULL;
+    }
+
+  /* skip IFD0 to IFD1 */
+  ifd = IMAGE_EXIF_U32 (tiff + 4);
+  if (ifd + 2 > size)
+    {
+      return NULL;
+    }
+  n = IMAGE_EXIF_U16 (tiff + ifd);
+  if (ifd + 2 + n * 12 + 4 > size)
+    {
+      return NULL;
+    }
+  ifd = IMAGE_EXIF_U32 (tiff + ifd + 2 + n * 12);
+  if (ifd == 0 || ifd + 2 > size)
+    {
+      return NULL;
+    }
+  n = IMAGE_EXIF_U16 (tiff + ifd);
+  if (ifd + 2 + n * 12 > size)
+    {
+      return NULL;
+    }
+
+  offset = 0;
+  length = 0;
+  for (i = 0; i < n; ++i)
+    {
+      entry = tiff + ifd + 2 + i * 12;
+      tag = IMAGE_EXIF_U16 (entry);
+      if (tag == 0x0201)
+        {
+          offset = IMAGE_EXIF_U32 (entry + 8);
+        }
+      else if (tag == 0x0202)
+        {
+          length = IMAGE_EXIF_U32 (entry + 8);
+        }
+    }
+
+  if (offset == 0 || length < 4 || offset > size || length > size - offset
+      || tiff[offset] != 0xFF || tiff[offset + 1] != 0xD8)
+    {
+      return NULL;
+    }
+
+  *thumb_len = length;
+  return tiff + offset;
+}
+
+static void
+image_jpeg_error_exit (j_common_ptr cinfo)
+{
+  longjmp (((struct image_jpeg_error *)cinfo->err)->jmp, 1);
+}
+
+static void
+image_jpeg_silent (j_common_ptr cinfo)
+{
+}
+#endif
@@ -31,4 +31,11 @@
 GdkPixbuf *fdupves_gdkpixbuf_load_file_at_size (const gchar *, int, int,
                                                 GError **);
 
+/* the small image a hash is taken from, exactly w x h:
+ * a jpeg is decoded at the smallest DCT scale still covering the size, or
+ * from its exif thumbnail when image_thumbnail is set; other formats go
+ * through gdk-pixbuf */
+GdkPixbuf *fdupves_gdkpixbuf_load_file_for_hash (const gchar *, int, int,
+                                                 GError **);
+
 #endif
@@ -26,9 +26,11 @@
 /* @date Created: 2013/01/16 12:03:42 Alf*/
 
 #include "ini.h"
+#include "hash.h"
 #include "util.h"
 
 #include <glib.h>
+#include <string.h>
 
 ini_t *g_ini;
 
@@ -81,6 +83,14 @@ ini_new ()
   ini->same_image_distance = 6;
   ini->same_video_distance = 8;
   ini->same_audio_distance = 2;
+  ini->same_image_verify = 48;
+  ini->image_symmetric = FALSE;
+
+  ini->audio_align = FALSE;
+
+  ini->incremental = FALSE;
+  ini->image_thumbnail = FALSE;
+  ini->hash_algs = FDUPVES_HASH_ALG (FDUPVES_IMAGE_HASH);
 
   ini->threads_count = 1;
 
@@ -101,6 +111,8 @@ ini_new ()
   ini->video_timers[3][2] = 600;
   ini->video_timers[4][0] = 0;
 
+  ini->video_frames = 0;
+
   ini->directories = NULL;
 
   ini->cache_file
@@ -147,8 +159,9 @@ ini_new_with_file (const gchar *file)
 gboolean
 ini_load (ini_t *ini, const gchar *file)
 {
-  gchar *path, *tmpstr;
-  gint level, count;
+  gchar *path, *tmpstr, **names;
+  gint level, count, alg;
+  gsize i, n;
   GError *err;
 
   path = fd_realpath (file);
@@ -228,6 +241,64 @@ ini_load (ini_t *ini, const gchar *file)
           ini->keyfile, "_", "filter_time_rate", NULL);
     }
 
+  if (g_key_file_has_key (ini->keyfile, "_", "audio_align", NULL))
+    {
+      ini->audio_align
+          = g_key_file_get_boolean (ini->keyfile, "_", "audio_align", NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "incremental", NULL))
+    {
+      ini->incremental
+          = g_key_file_get_boolean (ini->keyfile, "_", "incremental", NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "image_thumbnail", NULL))
+    {
+      ini->image_thumbnail = g_key_file_get_boolean (
+          ini->keyfile, "_", "image_thumbnail", NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "same_image_verify", NULL))
+    {
+      ini->same_image_verify = CLAMP (
+          g_key_file_get_integer (ini->keyfile, "_", "same_image_verify",
+                                  NULL),
+          0, FDUPVES_HASH256_BITS);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "image_symmetric", NULL))
+    {
+      ini->image_symmetric = g_key_file_get_boolean (
+          ini->keyfile, "_", "image_symmetric", NULL);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "hash_algorithms", NULL))
+    {
+      names = g_key_file_get_string_list (ini->keyfile, "_",
+                                          "hash_algorithms", &n, NULL);
+      ini->hash_algs = 0;
+      for (i = 0; i < n; ++i)
+        {
+          g_strstrip (names[i]);
+          for (alg = 0; alg < FDUPVES_IMAGE_SIGS; ++alg)
+            {
+              if (strcmp (names[i], hash_phrase[alg]) == 0)
+                {
+                  ini->hash_algs |= FDUPVES_HASH_ALG (alg);
+                }
+            }
+        }
+      g_strfreev (names);
+    }
+
+  if (g_key_file_has_key (ini->keyfile, "_", "video_frames", NULL))
+    {
+      ini->video_frames = CLAMP (
+          g_key_file_get_integer (ini->keyfile, "_", "video_frames", NULL), 0,
+          FDUPVES_VIDEO_FRAMES_MAX);
+    }
+
   if (g_key_file_has_key (ini->keyfile, "_", "compare_count", NULL))
     {
       ini->compare_count
@@ -260,7 +331,9 @@ gboolean
 ini_save (ini_t *ini, const gchar *file)
 {
   gchar *data, *path, *tmpstr;
-  gsize len;
+  const gchar *names[FDUPVES_IMAGE_SIGS];
+  gsize len, n;
+  gint alg;
 
   path = fd_realpath (file);
   g_return_val_if_fail (path, FALSE);
@@ -286,6 +359,27 @@ ini_save (ini_t *ini, const gchar *file)
                           ini->filter_time_rate);
   g_key_file_set_integer (ini->keyfile, "_", "compare_count",
                           ini->compare_count);
+  g_key_file_set_boolean (ini->keyfile, "_", "audio_align",
+                          ini->audio_align);
+  g_key_file_set_boolean (ini->keyfile, "_", "incremental",
+                          ini->incremental);
+  g_key_file_set_boolean (ini->keyfile, "_", "image_thumbnail",
+                          ini->image_thumbnail);
+  g_key_file_set_integer (ini->keyfile, "_", "video_frames",
+                          ini->video_frames);
+  g_key_file_set_integer (ini->keyfile, "_", "same_image_verify",
+                          ini->same_image_verify);
+  g_key_file_set_boolean (ini->keyfile, "_", "image_symmetric",
+                          ini->image_symmetric);
+  for (alg = 0, n = 0; alg < FDUPVES_IMAGE_SIGS; ++alg)
+    {
+      if (ini->hash_algs & FDUPVES_HASH_ALG (alg))
+        {
+          names[n++] = hash_phrase[alg];
+        }
+    }
+  g_key_file_set_string_list (ini->keyfile, "_", "hash_algorithms", names,
+                              n);
 
   g_key_file_set_string_list (ini->keyfile, "_", "directories",
                               (const gchar *const *)ini->directories,
@@ -38,6 +38,10 @@
 #define SAME_RATE_MAX 10
 #endif
 
+#ifndef FDUPVES_VIDEO_FRAMES_MAX
+#define FDUPVES_VIDEO_FRAMES_MAX 64
+#endif
+
 typedef struct
 {
   gboolean verbose;
@@ -66,12 +70,36 @@ typedef struct
   gint same_video_distance;
   gint same_audio_distance;
 
+  /* a candidate image pair is kept when its 256 bits perceptual hashes
+   * are closer than this, 0 keeps every candidate */
+  gint same_image_verify;
+
+  /* images also match their rotated and mirrored copies */
+  gboolean image_symmetric;
+
+  /* audio match only on hashes at one consistent time offset */
+  gboolean audio_align;
+
+  /* only hash and compare the files changed since the last scan */
+  gboolean incremental;
+
   gint threads_count;
 
   gint thumb_size[2];
 
+  /* hash a jpeg from its exif thumbnail when it has one */
+  gboolean image_thumbnail;
+
+  /* FDUPVES_HASH_ALG mask of the image signatures computed, and cached,
+   * from every decode; the one a find compares is always there */
+  gint hash_algs;
+
   gint video_timers[0x10][3];
 
+  /* frames of the video signature, 0 compares the head and tail of the
+   * timer groups */
+  gint video_frames;
+
   gchar **directories;
   gsize directory_count;
 
@@ -0,0 +1,253 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE jsonl.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "jsonl.h"
+#include "group.h"
+
+#include <glib.h>
+#include <stdio.h>
+
+struct jsonl_s
+{
+  FILE *fp;
+  GString *line;
+
+  same_group_t *groups;
+
+  /* same_type of the first pair of every interned path */
+  GArray *types;
+};
+
+static const gchar *jsonl_media (same_type);
+
+static gboolean jsonl_string (GString *, const gchar *);
+
+static void jsonl_write (jsonl_t *);
+
+jsonl_t *
+jsonl_new (FILE *fp)
+{
+  jsonl_t *jsonl;
+
+  jsonl = g_new0 (jsonl_t, 1);
+  g_return_val_if_fail (jsonl, NULL);
+
+  jsonl->fp = fp;
+  jsonl->line = g_string_sized_new (0x200);
+  jsonl->groups = same_group_new ();
+  jsonl->types = g_array_new (FALSE, FALSE, sizeof (same_type));
+
+  return jsonl;
+}
+
+void
+jsonl_free (jsonl_t *jsonl)
+{
+  g_string_free (jsonl->line, TRUE);
+  same_group_free (jsonl->groups);
+  g_array_free (jsonl->types, TRUE);
+  g_free (jsonl);
+}
+
+void
+jsonl_step (jsonl_t *jsonl, const find_step *step)
+{
+  GString *line;
+  gchar num[G_ASCII_DTOSTR_BUF_SIZE];
+  gboolean araw, braw;
+  guint a, b;
+
+  if (!step->found && !step->removed)
+    {
+      return;
+    }
+
+  line = jsonl->line;
+  g_string_assign (line, "{\"a\":");
+  araw = jsonl_string (line, step->afile);
+  g_string_append (line, ",\"b\":");
+  braw = jsonl_string (line, step->bfile);
+  if (araw)
+    {
+      g_string_append (line, ",\"a_raw\":true");
+    }
+  if (braw)
+    {
+      g_string_append (line, ",\"b_raw\":true");
+    }
+  g_string_append_printf (line, ",\"type\":\"%s\"",
+                          find_type_name (step->type));
+
+  if (step->distance >= 0)
+    {
+      g_string_append_printf (line, ",\"distance\":%d", step->distance);
+    }
+  else
+    {
+      g_string_append (line, ",\"distance\":null");
+    }
+
+  /* the alignment only means something for sequences */
+  if (step->type == FD_SAME_AUDIO_HEAD || step->type == FD_SAME_AUDIO_TAIL
+      || step->type == FD_SAME_VIDEO_FRAMES)
+    {
+      g_string_append_printf (
+          line, ",\"offset\":%s",
+          g_ascii_formatd (num, sizeof num, "%.3f", step->offset));
+    }
+
+  if (step->removed)
+    {
+      g_string_append (line, ",\"removed\":true");
+    }
+  g_string_append (line, "}\n");
+  jsonl_write (jsonl);
+
+  if (step->removed)
+    {
+      return;
+    }
+
+  a = same_group_intern (jsonl->groups, step->afile);
+  b = same_group_intern (jsonl->groups, step->bfile);
+  while (jsonl->types->len < same_group_size (jsonl->groups))
+    {
+      g_array_append_val (jsonl->types, step->type);
+    }
+  same_group_union (jsonl->groups, a, b);
+}
+
+void
+jsonl_finish (jsonl_t *jsonl)
+{
+  GPtrArray *sets;
+  GArray *ids, *raws;
+  GString *line;
+  guint i, j, id;
+
+  line = jsonl->line;
+  raws = g_array_new (FALSE, FALSE, sizeof (guint));
+  sets = same_group_collect (jsonl->groups);
+  for (i = 0; i < sets->len; ++i)
+    {
+      ids = g_ptr_array_index (sets, i);
+      id = g_array_index (ids, guint, 0);
+
+      g_string_printf (
+          line, "{\"group\":%u,\"media\":\"%s\",\"files\":[", i,
+          jsonl_media (g_array_index (jsonl->types, same_type, id)));
+      for (j = 0; j < ids->len; ++j)
+        {
+          if (j > 0)
+            {
+              g_string_append_c (line, ',');
+            }
+          id = g_array_index (ids, guint, j);
+          if (jsonl_string (line, same_group_path (jsonl->groups, id)))
+            {
+              g_array_append_val (raws, j);
+            }
+        }
+      g_string_append_c (line, ']');
+
+      /* the indexes of the files written byte by byte */
+      if (raws->len > 0)
+        {
+          g_string_append (line, ",\"raw\":[");
+          for (j = 0; j < raws->len; ++j)
+            {
+              g_string_append_printf (line, j > 0 ? ",%u" : "%u",
+                                      g_array_index (raws, guint, j));
+            }
+          g_string_append_c (line, ']');
+          g_array_set_size (raws, 0);
+        }
+      g_string_append (line, "}\n");
+      jsonl_write (jsonl);
+    }
+  g_array_free (raws, TRUE);
+  g_ptr_array_free (sets, TRUE);
+}
+
+static const gchar *
+jsonl_media (same_type type)
+{
+  switch (type)
+    {
+    case FD_SAME_IMAGE:
+      return "image";
+
+    case FD_SAME_AUDIO_HEAD:
+    case FD_SAME_AUDIO_TAIL:
+      return "audio";
+
+    case FD_SAME_EBOOK:
+      return "ebook";
+
+    default:
+      return "video";
+    }
+}
+
+/* paths are written as they are, only the bytes json forbids are escaped.
+ * a path that is not UTF-8 has every byte above 0x7f escaped as \u00XX,
+ * one code point per byte, and TRUE is returned */
+static gboolean
+jsonl_string (GString *line, const gchar *str)
+{
+  const guchar *p;
+  gboolean raw;
+
+  raw = !g_utf8_validate (str, -1, NULL);
+  g_string_append_c (line, '"');
+  for (p = (const guchar *)str; *p; ++p)
+    {
+      if (*p == '"' || *p == '\\')
+        {
+          g_string_append_c (line, '\\');
+          g_string_append_c (line, *p);
+        }
+      else if (*p < 0x20 || (raw && *p > 0x7f))
+        {
+          g_string_append_printf (line, "\\u%04x", *p);
+        }
+      else
+        {
+          g_string_append_c (line, *p);
+        }
+    }
+  g_string_append_c (line, '"');
+
+  return raw;
+}
+
+/* one line a time, a reader following the file never sees half of one */
+static void
+jsonl_write (jsonl_t *jsonl)
+{
+  fwrite (jsonl->line->str, 1, jsonl->line->len, jsonl->fp);
+  fflush (jsonl->fp);
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE jsonl.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_JSONL_H_
+#define _FDUPVES_JSONL_H_
+
+#include "find.h"
+
+#include <glib.h>
+#include <stdio.h>
+
+/* json lines sink of find_step:
+ * every pair is one line as soon as it is found,
+ * {"a":..,"b":..,"type":..,"distance":..,"offset":..}
+ * and jsonl_finish adds one line per group of the same files,
+ * {"group":..,"media":..,"files":[..]}
+ */
+typedef struct jsonl_s jsonl_t;
+
+jsonl_t *jsonl_new (FILE *);
+
+void jsonl_free (jsonl_t *);
+
+/* not thread safe, the caller serializes the steps */
+void jsonl_step (jsonl_t *, const find_step *);
+
+void jsonl_finish (jsonl_t *);
+
+#endif
@@ -26,6 +26,7 @@
 /* @date Created: 2013/01/16 10:12:33 Alf*/
 
 #include "cache.h"
+#include "cli.h"
 #include "gui.h"
 #include "ini.h"
 #include "util.h"
@@ -85,6 +86,12 @@ main (int argc, char *argv[])
   CoInitializeEx (NULL, COINIT_MULTITHREADED);
 #endif
 
+  /* no display needed, GTK is never initialized */
+  if (cli_wanted (argc, argv))
+    {
+      return cli_main (argc, argv);
+    }
+
   gdk_threads_init ();
 
   gtk_init (&argc, &argv);
@@ -0,0 +1,683 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE match.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "match.h"
+#include "audio_index.h"
+#include "hindex.h"
+#include "ini.h"
+#include "util.h"
+
+#include <string.h>
+
+struct match_domain_s
+{
+  int type;
+  GPtrArray *paths;
+  int ngroups;
+  hash_index_t *heads[FD_MATCH_GROUPS];
+  hash_index_t *tails[FD_MATCH_GROUPS];
+  audio_index_t *peaks;
+  GArray *lengths;
+
+  /* the lengths were added ascending: a file only meets the window of
+   * the shorter ones filter_time_rate still compares with it */
+  gboolean sorted;
+
+  /* video signatures, one after the other; the frames index is heads[0] */
+  GArray *frames;
+
+  /* images: the 256 bits signature of every file, once a candidate pair
+   * needed it */
+  GArray *sigs;
+};
+
+struct match_sig
+{
+  gboolean done;
+  hash256_t sig;
+
+  /* symmetric images: the image_file_dct256 every orient is derived
+   * from, NULL when the file did not load */
+  gdouble *coeffs;
+};
+
+/* an id met by a query, a hit met twice keeps the first */
+struct match_hit
+{
+  guint id;
+  int dist;
+
+  /* symmetric images: the orient of cur that met it */
+  int orient;
+
+  /* videos: met by a head or a tail */
+  same_type type;
+  guint order;
+};
+
+struct match_query
+{
+  match_domain_t *domain;
+  guint cur;
+  match_skip_func skip;
+  gpointer arg;
+  GArray *out;
+
+  /* the first id the lengths compare with */
+  guint lo;
+
+  /* match_hit, every id once after match_hits_unique */
+  GArray *hits;
+
+  /* the orient of cur and the type being queried */
+  int orient;
+  same_type type;
+};
+
+static void match_query_hash (struct match_query *, same_type);
+
+static void match_query_video (struct match_query *);
+
+static void match_query_frames (struct match_query *);
+
+static gboolean match_candidate (struct match_query *, guint);
+
+static gboolean match_lengths (match_domain_t *, guint, guint);
+
+static guint match_window (match_domain_t *, guint);
+
+static void match_hit_func (guint, int, struct match_query *);
+
+static void match_frame_func (guint, int, struct match_query *);
+
+static void match_audio_func (guint, guint, struct match_query *);
+
+static void match_hits_unique (struct match_query *);
+
+static gint match_hit_cmp (const struct match_hit *,
+                           const struct match_hit *);
+
+match_domain_t *
+match_domain_new (int type, gsize hint)
+{
+  match_domain_t *domain;
+  hash_t mask;
+  int g;
+
+  domain = g_new0 (match_domain_t, 1);
+  domain->type = type;
+  domain->paths = g_ptr_array_new_with_free_func (g_free);
+  domain->sorted = TRUE;
+
+  mask = hash_compare_mask (g_ini->compare_area);
+  switch (type)
+    {
+    case FD_IMAGE:
+    case FD_EBOOK:
+      /* an area is not where it was once the image turns */
+      if (type == FD_IMAGE && g_ini->image_symmetric)
+        {
+          mask = hash_compare_mask (FD_COMPARE_ALL);
+        }
+      domain->ngroups = 1;
+      domain->heads[0]
+          = hash_index_new (mask, g_ini->same_image_distance, hint);
+      if (type == FD_IMAGE && g_ini->same_image_verify > 0)
+        {
+          domain->sigs
+              = g_array_new (FALSE, FALSE, sizeof (struct match_sig));
+        }
+      break;
+
+    case FD_VIDEO:
+      domain->lengths = g_array_new (FALSE, FALSE, sizeof (float));
+      if (g_ini->video_frames > 0)
+        {
+          domain->heads[0]
+              = hash_index_new (mask, g_ini->same_video_distance,
+                                hint * g_ini->video_frames);
+          domain->frames = g_array_new (FALSE, FALSE, sizeof (hash_t));
+          break;
+        }
+
+      for (g = 0; g < FD_MATCH_GROUPS && g_ini->video_timers[g][0]; ++g)
+        {
+          domain->heads[g]
+              = hash_index_new (mask, g_ini->same_video_distance, hint);
+          domain->tails[g]
+              = hash_index_new (mask, g_ini->same_video_distance, hint);
+        }
+      domain->ngroups = g;
+      break;
+
+    case FD_AUDIO:
+      domain->peaks = audio_index_new ();
+      domain->lengths = g_array_new (FALSE, FALSE, sizeof (float));
+      break;
+
+    default:
+      break;
+    }
+
+  return domain;
+}
+
+void
+match_domain_free (match_domain_t *domain)
+{
+  int g;
+
+  g_ptr_array_free (domain->paths, TRUE);
+  for (g = 0; g < FD_MATCH_GROUPS; ++g)
+    {
+      if (domain->heads[g])
+        {
+          hash_index_free (domain->heads[g]);
+        }
+      if (domain->tails[g])
+        {
+          hash_index_free (domain->tails[g]);
+        }
+    }
+  if (domain->peaks)
+    {
+      audio_index_free (domain->peaks);
+    }
+  if (domain->lengths)
+    {
+      g_array_free (domain->lengths, TRUE);
+    }
+  if (domain->frames)
+    {
+      g_array_free (domain->frames, TRUE);
+    }
+  if (domain->sigs)
+    {
+      for (g = 0; g < (int)domain->sigs->len; ++g)
+        {
+          g_free (g_array_index (domain->sigs, struct match_sig, g).coeffs);
+        }
+      g_array_free (domain->sigs, TRUE);
+    }
+  g_free (domain);
+}
+
+guint
+match_domain_add (match_domain_t *domain, const gchar *path,
+                  const match_file *file)
+{
+  struct match_sig sig[1];
+  guint id;
+  int f, g;
+
+  id = domain->paths->len;
+  g_ptr_array_add (domain->paths, g_strdup (path));
+  if (domain->lengths)
+    {
+      if (id > 0
+          && g_array_index (domain->lengths, float, id - 1) > file->length)
+        {
+          domain->sorted = FALSE;
+        }
+      g_array_append_val (domain->lengths, file->length);
+    }
+  if (domain->sigs)
+    {
+      memset (sig, 0, sizeof sig);
+      g_array_append_val (domain->sigs, *sig);
+    }
+
+  if (domain->peaks)
+    {
+      audio_index_add (domain->peaks, id, file->peaks);
+    }
+  else if (domain->frames)
+    {
+      g_array_append_vals (domain->frames, file->frames,
+                           g_ini->video_frames);
+      for (f = 0; f < g_ini->video_frames; ++f)
+        {
+          hash_index_insert (domain->heads[0], file->frames[f]);
+        }
+    }
+  else
+    {
+      /* every group indexes every file, the ones out of it with hash 0
+       * that never matches, so the ids are the same in all of them */
+      for (g = 0; g < domain->ngroups; ++g)
+        {
+          hash_index_insert (domain->heads[g], file->heads[g]);
+          if (domain->tails[g])
+            {
+              hash_index_insert (domain->tails[g], file->tails[g]);
+            }
+        }
+    }
+
+  return id;
+}
+
+guint
+match_domain_size (match_domain_t *domain)
+{
+  return domain->paths->len;
+}
+
+const gchar *
+match_domain_path (match_domain_t *domain, guint id)
+{
+  return g_ptr_array_index (domain->paths, id);
+}
+
+void
+match_domain_query (match_domain_t *domain, guint cur, match_skip_func skip,
+                    gpointer arg, GArray *out)
+{
+  struct match_query query[1];
+
+  memset (query, 0, sizeof query);
+  query->domain = domain;
+  query->cur = cur;
+  query->skip = skip;
+  query->arg = arg;
+  query->out = out;
+  query->lo = match_window (domain, cur);
+
+  switch (domain->type)
+    {
+    case FD_IMAGE:
+      match_query_hash (query, FD_SAME_IMAGE);
+      break;
+
+    case FD_EBOOK:
+      match_query_hash (query, FD_SAME_EBOOK);
+      break;
+
+    case FD_VIDEO:
+      if (domain->frames)
+        {
+          match_query_frames (query);
+        }
+      else
+        {
+          match_query_video (query);
+        }
+      break;
+
+    case FD_AUDIO:
+      audio_index_similar (domain->peaks, cur, query->lo,
+                           (audio_index_func)match_audio_func, query);
+      break;
+
+    default:
+      break;
+    }
+}
+
+void
+match_domain_sign (match_domain_t *domain, guint id)
+{
+  struct match_sig *sig;
+
+  sig = &g_array_index (domain->sigs, struct match_sig, id);
+  if (sig->done)
+    {
+      return;
+    }
+
+  /* the pairs of a symmetric image may need b turned */
+  if (g_ini->image_symmetric)
+    {
+      sig->coeffs = g_new (gdouble, FDUPVES_HASH256_BITS);
+      if (image_file_dct256 (g_ptr_array_index (domain->paths, id),
+                             sig->coeffs))
+        {
+          hash_dct256_orient (sig->coeffs, 0, &sig->sig);
+        }
+      else
+        {
+          g_free (sig->coeffs);
+          sig->coeffs = NULL;
+        }
+    }
+  else
+    {
+      image_file_phash256 (g_ptr_array_index (domain->paths, id), &sig->sig);
+    }
+  sig->done = TRUE;
+}
+
+/* a file without signature can not be verified and keeps its pairs; b
+ * turned by orient is signed from its coefficients */
+gboolean
+match_domain_verify (match_domain_t *domain, const compare_match *match)
+{
+  struct match_sig *sa, *sb;
+  hash256_t turned[1];
+  int dist;
+
+  if (domain->sigs == NULL)
+    {
+      return TRUE;
+    }
+
+  match_domain_sign (domain, match->a);
+  match_domain_sign (domain, match->b);
+  sa = &g_array_index (domain->sigs, struct match_sig, match->a);
+  sb = &g_array_index (domain->sigs, struct match_sig, match->b);
+  if (match->orient && sb->coeffs)
+    {
+      hash_dct256_orient (sb->coeffs, match->orient, turned);
+      dist = hash256_distance (&sa->sig, turned);
+    }
+  else
+    {
+      dist = hash256_distance (&sa->sig, &sb->sig);
+    }
+
+  return dist < 0 || dist < g_ini->same_image_verify;
+}
+
+gboolean
+match_domain_verifies (match_domain_t *domain)
+{
+  return domain->sigs != NULL;
+}
+
+static void
+match_query_hash (struct match_query *query, same_type type)
+{
+  match_domain_t *domain;
+  compare_match match[1];
+  struct match_hit *hit;
+  hash_t hash, variants[FDUPVES_ORIENTS];
+  guint i;
+  int o;
+
+  domain = query->domain;
+  query->hits = g_array_new (FALSE, FALSE, sizeof (struct match_hit));
+  query->type = type;
+
+  hash = hash_index_get (domain->heads[0], query->cur);
+  if (type == FD_SAME_IMAGE && g_ini->image_symmetric)
+    {
+      /* a symmetric image meets its pairs from more than one orient */
+      hash_sphash_orients (hash, variants);
+      for (o = 0; o < FDUPVES_ORIENTS; ++o)
+        {
+          query->orient = o;
+          hash_index_query_range (domain->heads[0], variants[o], 0,
+                                  query->cur,
+                                  (hash_index_func)match_hit_func, query);
+        }
+    }
+  else
+    {
+      hash_index_query_range (domain->heads[0], hash, 0, query->cur,
+                              (hash_index_func)match_hit_func, query);
+    }
+  match_hits_unique (query);
+
+  match->b = query->cur;
+  match->type = type;
+  match->offset = 0;
+  for (i = 0; i < query->hits->len; ++i)
+    {
+      hit = &g_array_index (query->hits, struct match_hit, i);
+      match->a = hit->id;
+      match->distance = hit->dist;
+      match->orient = hit->orient;
+      g_array_append_val (query->out, *match);
+    }
+
+  g_array_free (query->hits, TRUE);
+}
+
+static void
+match_query_video (struct match_query *query)
+{
+  match_domain_t *domain;
+  compare_match match[1];
+  struct match_hit *hit;
+  guint i;
+  int g;
+
+  domain = query->domain;
+  query->hits = g_array_new (FALSE, FALSE, sizeof (struct match_hit));
+
+  /* a pair matched by overlapping groups is reported once, the heads of
+   * every group are queried first so a head match wins over a tail one */
+  query->type = FD_SAME_VIDEO_HEAD;
+  for (g = 0; g < domain->ngroups; ++g)
+    {
+      hash_index_query_range (domain->heads[g],
+                              hash_index_get (domain->heads[g], query->cur),
+                              query->lo, query->cur,
+                              (hash_index_func)match_hit_func, query);
+    }
+  query->type = FD_SAME_VIDEO_TAIL;
+  for (g = 0; g < domain->ngroups; ++g)
+    {
+      hash_index_query_range (domain->tails[g],
+                              hash_index_get (domain->tails[g], query->cur),
+                              query->lo, query->cur,
+                              (hash_index_func)match_hit_func, query);
+    }
+  match_hits_unique (query);
+
+  match->b = query->cur;
+  match->offset = 0;
+  match->orient = 0;
+  for (i = 0; i < query->hits->len; ++i)
+    {
+      hit = &g_array_index (query->hits, struct match_hit, i);
+      match->a = hit->id;
+      match->type = hit->type;
+      match->distance = hit->dist;
+      g_array_append_val (query->out, *match);
+    }
+
+  g_array_free (query->hits, TRUE);
+}
+
+/* candidates share at least one close frame, the sequences judge them */
+static void
+match_query_frames (struct match_query *query)
+{
+  match_domain_t *domain;
+  compare_match match[1];
+  const hash_t *frames;
+  guint i, j;
+  int f, count;
+
+  domain = query->domain;
+  count = g_ini->video_frames;
+  frames = (const hash_t *)domain->frames->data;
+  query->hits = g_array_new (FALSE, FALSE, sizeof (struct match_hit));
+
+  /* the frames of a file are indexed one after the other */
+  for (f = 0; f < count; ++f)
+    {
+      hash_index_query_range (domain->heads[0],
+                              frames[(gsize)query->cur * count + f],
+                              query->lo * count, query->cur * count,
+                              (hash_index_func)match_frame_func, query);
+    }
+
+  /* every candidate once, however many frames it shares */
+  match_hits_unique (query);
+  for (i = 0; i < query->hits->len; ++i)
+    {
+      j = g_array_index (query->hits, struct match_hit, i).id;
+      if (compare_video_frames (
+              frames + (gsize)j * count, frames + (gsize)query->cur * count,
+              count, g_array_index (domain->lengths, float, query->cur),
+              match))
+        {
+          match->a = j;
+          match->b = query->cur;
+          g_array_append_val (query->out, *match);
+        }
+    }
+
+  g_array_free (query->hits, TRUE);
+}
+
+/* every pair is met from both sides, keep the one from the later file */
+static gboolean
+match_candidate (struct match_query *query, guint id)
+{
+  if (id >= query->cur || id < query->lo)
+    {
+      return FALSE;
+    }
+
+  /* in the window, the lengths compare */
+  if (query->domain->type == FD_VIDEO && !query->domain->sorted
+      && !match_lengths (query->domain, id, query->cur))
+    {
+      return FALSE;
+    }
+
+  return query->skip == NULL || !query->skip (id, query->cur, query->arg);
+}
+
+static gboolean
+match_lengths (match_domain_t *domain, guint a, guint b)
+{
+  float alen, blen;
+
+  alen = g_array_index (domain->lengths, float, a);
+  blen = g_array_index (domain->lengths, float, b);
+
+  return compare_length_max (MIN (alen, blen)) >= MAX (alen, blen);
+}
+
+/* the first id whose length still compares with the one of cur, 0 unless
+ * the lengths are sorted */
+static guint
+match_window (match_domain_t *domain, guint cur)
+{
+  const float *lengths;
+  guint lo, hi, mid;
+
+  if (domain->lengths == NULL || !domain->sorted)
+    {
+      return 0;
+    }
+
+  /* compare_length_max grows with the length */
+  lengths = (const float *)domain->lengths->data;
+  lo = 0;
+  hi = cur;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (compare_length_max (lengths[mid]) < lengths[cur])
+        {
+          lo = mid + 1;
+        }
+      else
+        {
+          hi = mid;
+        }
+    }
+
+  return lo;
+}
+
+static void
+match_hit_func (guint id, int dist, struct match_query *query)
+{
+  struct match_hit hit[1];
+
+  if (!match_candidate (query, id))
+    {
+      return;
+    }
+
+  hit->id = id;
+  hit->dist = dist;
+  hit->orient = query->orient;
+  hit->type = query->type;
+  hit->order = query->hits->len;
+  g_array_append_val (query->hits, *hit);
+}
+
+static void
+match_frame_func (guint id, int dist, struct match_query *query)
+{
+  match_hit_func (id / g_ini->video_frames, dist, query);
+}
+
+static void
+match_audio_func (guint id, guint shared, struct match_query *query)
+{
+  compare_match match[1];
+  float *lengths;
+
+  if (!match_candidate (query, id))
+    {
+      return;
+    }
+
+  lengths = (float *)query->domain->lengths->data;
+  if (compare_audio (query->domain->peaks, id, query->cur, shared,
+                     lengths[id], lengths[query->cur], match))
+    {
+      g_array_append_val (query->out, *match);
+    }
+}
+
+/* sorted by id, the first hit of every id kept */
+static void
+match_hits_unique (struct match_query *query)
+{
+  struct match_hit *hits;
+  guint i, n;
+
+  g_array_sort (query->hits, (GCompareFunc)match_hit_cmp);
+  hits = (struct match_hit *)query->hits->data;
+  for (i = 0, n = 0; i < query->hits->len; ++i)
+    {
+      if (n == 0 || hits[n - 1].id != hits[i].id)
+        {
+          hits[n++] = hits[i];
+        }
+    }
+  g_array_set_size (query->hits, n);
+}
+
+static gint
+match_hit_cmp (const struct match_hit *a, const struct match_hit *b)
+{
+  if (a->id != b->id)
+    {
+      return (a->id > b->id) - (a->id < b->id);
+    }
+
+  return (a->order > b->order) - (a->order < b->order);
+}
@@ -0,0 +1,93 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE match.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_MATCH_H_
+#define _FDUPVES_MATCH_H_
+
+#include "compare.h"
+#include "hash.h"
+
+#include <glib.h>
+
+/* video timer groups */
+#ifndef FD_MATCH_GROUPS
+#define FD_MATCH_GROUPS 0x10
+#endif
+
+/* the hashes of a file, whichever engine computed them */
+typedef struct
+{
+  /* image and ebook cover in the first, video head and tail of every
+   * timer group, 0 out of the groups covering its length */
+  hash_t heads[FD_MATCH_GROUPS];
+  hash_t tails[FD_MATCH_GROUPS];
+
+  /* video signature, g_ini->video_frames hashes */
+  hash_t *frames;
+
+  /* video and audio */
+  float length;
+  hash_array_t *peaks;
+} match_file;
+
+/* the files of one media type, FD_IMAGE .. FD_EBOOK, ids in the order
+ * they were added */
+typedef struct match_domain_s match_domain_t;
+
+/* TRUE when the pair a < b needs no compare */
+typedef gboolean (*match_skip_func) (guint a, guint b, gpointer);
+
+match_domain_t *match_domain_new (int type, gsize hint);
+
+void match_domain_free (match_domain_t *);
+
+/* the id of path, the hashes of file are copied; videos and audios added
+ * by ascending length only query the window of lengths filter_time_rate
+ * compares */
+guint match_domain_add (match_domain_t *, const gchar *path,
+                        const match_file *);
+
+guint match_domain_size (match_domain_t *);
+
+const gchar *match_domain_path (match_domain_t *, guint);
+
+/* the matches of cur with the ids before it appended to out, skip may be
+ * NULL; once the files are added the queries can run on any thread */
+void match_domain_query (match_domain_t *, guint cur, match_skip_func,
+                         gpointer, GArray *out);
+
+/* images: the 256 bits signature of id, computed once; distinct ids can
+ * be signed on several threads */
+void match_domain_sign (match_domain_t *, guint);
+
+/* TRUE when the 256 bits signatures keep an image match, or the domain
+ * does not verify */
+gboolean match_domain_verify (match_domain_t *, const compare_match *);
+
+/* TRUE when match_domain_verify needs the signatures */
+gboolean match_domain_verifies (match_domain_t *);
+
+#endif
@@ -24,178 +24,217 @@
  *  Author: Alf <naihe2010@126.com>
  */
 
-#include "cache.h"
 #include "hash.h"
+#include "cache.h"
 #include "image.h"
-#include "util.h"
-#include "video.h"
+#include "ini.h"
 
 #include <glib.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#define FDUPVES_PHASH_LEN 32
 #define FDUPVES_DCT_LEN 8
 
-static hash_t pixbuf_phash (GdkPixbuf *);
+/* the low frequencies of the 256 bits signature */
+#define FDUPVES_DCT256_LEN 16
+
+static void phash_grays (const guchar *, int, int, unsigned char *);
 
-static gboolean buffer_dct (const unsigned char *, unsigned char *, gsize);
+static gboolean phash_file_grays (const char *, unsigned char *);
 
-static const gdouble *get_coefficient ();
+static int phash_coeff_cmp (const gdouble *, const gdouble *);
 
-static const gdouble *get_coefficient_t ();
+static void phash_dct (const unsigned char *, int, gdouble *);
 
-static void matrix_mul (const gdouble *, const gdouble *, gdouble *);
+static const gdouble *phash_dct_table ();
+
+static inline void phash_mul_rows (const gdouble *, int, const gdouble *,
+                                   int, gdouble *);
+
+#ifdef __SSE2__
+static inline void phash_mul_rows_sse2 (const gdouble *, int,
+                                        const gdouble *, int, gdouble *);
+#endif
 
 hash_t
 image_file_phash (const char *file)
 {
-  GdkPixbuf *buf;
-  hash_t h;
-  GError *err;
+  hash_t hashs[FDUPVES_IMAGE_SIGS];
+
+  image_file_hashes (file,
+                     g_ini->hash_algs | FDUPVES_HASH_ALG (FDUPVES_IMAGE_PHASH),
+                     hashs);
+
+  return hashs[FDUPVES_IMAGE_PHASH];
+}
+
+hash_t
+video_time_phash (const char *file, float offset)
+{
+  hash_t hashs[FDUPVES_IMAGE_SIGS];
+
+  video_times_hashes (file, &offset, 1,
+                      g_ini->hash_algs | FDUPVES_HASH_ALG (FDUPVES_IMAGE_PHASH),
+                      hashs);
+
+  return hashs[FDUPVES_IMAGE_PHASH];
+}
+
+gboolean
+image_file_phash256 (const char *file, hash256_t *sig)
+{
+  gdouble coeffs[FDUPVES_HASH256_BITS];
 
   if (g_cache)
     {
-      if (cache_get (g_cache, file, 0, FDUPVES_IMAGE_PHASH, &h))
+      memset (sig, 0, sizeof (hash256_t));
+      if (cache_get_words (g_cache, file, 0, FDUPVES_IMAGE_PHASH256,
+                           sig->words, FDUPVES_HASH256_WORDS))
         {
-          return h;
+          return TRUE;
         }
     }
 
-  err = NULL;
-  buf = fdupves_gdkpixbuf_load_file_at_size (file, FDUPVES_PHASH_LEN,
-                                             FDUPVES_PHASH_LEN, &err);
-
-  if (err)
+  memset (sig, 0, sizeof (hash256_t));
+  if (!image_file_dct256 (file, coeffs))
     {
-      g_warning ("Load file: %s to pixbuf failed: %s", file, err->message);
-      g_error_free (err);
-      return 0;
+      return FALSE;
     }
-
-  h = pixbuf_phash (buf);
-  g_object_unref (buf);
+  hash_dct256_orient (coeffs, 0, sig);
 
   if (g_cache)
     {
-      if (h)
-        {
-          cache_set (g_cache, file, 0, FDUPVES_IMAGE_PHASH, h);
-        }
+      cache_set_words (g_cache, file, 0, FDUPVES_IMAGE_PHASH256, sig->words,
+                       FDUPVES_HASH256_WORDS);
     }
 
-  return h;
+  return TRUE;
 }
 
-hash_t
-buffer_phash (const char *buffer, int size)
+gboolean
+image_file_dct256 (const char *file, gdouble *coeffs)
 {
-  GdkPixbuf *buf;
-  GError *err;
-  hash_t h;
+  unsigned char grays[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
 
-  err = NULL;
-  buf = gdk_pixbuf_new_from_data (
-      (const guchar *)buffer, GDK_COLORSPACE_RGB, FALSE, 8, FDUPVES_PHASH_LEN,
-      FDUPVES_PHASH_LEN, FDUPVES_PHASH_LEN * 3, NULL, &err);
-  if (err)
+  if (!phash_file_grays (file, grays))
     {
-      g_warning ("Load inline data to pixbuf failed: %s", err->message);
-      g_error_free (err);
-      return 0;
+      return FALSE;
     }
 
-  h = pixbuf_phash (buf);
-  g_object_unref (buf);
+  phash_dct (grays, FDUPVES_DCT256_LEN, coeffs);
 
-  return h;
+  return TRUE;
 }
 
-hash_t
-video_time_phash (const char *file, float offset)
+/* DCT row u is the vertical frequency, column v the horizontal one */
+void
+hash_dct256_orient (const gdouble *coeffs, int orient, hash256_t *sig)
 {
-  hash_t h;
-  gchar buffer[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN * 3];
-#ifdef _DEBUG
-  gchar *basename, outfile[PATH_MAX];
-#endif
+  gdouble low[FDUPVES_HASH256_BITS], sorted[FDUPVES_HASH256_BITS], median;
+  int i, u, v;
 
-  if (g_cache)
+  for (u = 0; u < FDUPVES_DCT256_LEN; ++u)
     {
-      if (cache_get (g_cache, file, offset, FDUPVES_IMAGE_PHASH, &h))
+      for (v = 0; v < FDUPVES_DCT256_LEN; ++v)
         {
-          return h;
+          i = u * FDUPVES_DCT256_LEN + v;
+          low[i] = (orient & 1) ? coeffs[v * FDUPVES_DCT256_LEN + u]
+                                : coeffs[i];
+          if (((orient & 2) && (v & 1)) != ((orient & 4) && (u & 1)))
+            {
+              low[i] = -low[i];
+            }
         }
     }
 
-  video_time_screenshot (file, offset, FDUPVES_PHASH_LEN, FDUPVES_PHASH_LEN,
-                         buffer, sizeof buffer);
-#ifdef _DEBUG
-  basename = g_path_get_basename (file);
-  g_snprintf (outfile, sizeof outfile, "%s/%s-%f.png", g_get_tmp_dir (),
-              basename, offset);
-  g_free (basename);
-  video_time_screenshot_file (file, offset, FDUPVES_PHASH_LEN * 100,
-                              FDUPVES_PHASH_LEN * 100, outfile);
-#endif
+  /* half of the bits set, whatever the contrast of the image */
+  memcpy (sorted, low, sizeof low);
+  qsort (sorted, FDUPVES_HASH256_BITS, sizeof (gdouble),
+         (int (*) (const void *, const void *))phash_coeff_cmp);
+  median = (sorted[FDUPVES_HASH256_BITS / 2 - 1]
+            + sorted[FDUPVES_HASH256_BITS / 2])
+           / 2;
 
-  h = buffer_phash (buffer, sizeof buffer);
-
-  if (g_cache)
+  memset (sig, 0, sizeof (hash256_t));
+  for (i = 0; i < FDUPVES_HASH256_BITS; ++i)
     {
-      if (h)
+      if (low[i] > median)
         {
-          cache_set (g_cache, file, offset, FDUPVES_IMAGE_PHASH, h);
+          sig->words[i / FDUPVES_HASH_BITS]
+              |= (hash_t)1 << (i % FDUPVES_HASH_BITS);
         }
     }
-
-  return h;
 }
 
-static hash_t
-pixbuf_phash (GdkPixbuf *pixbuf)
+hash_t
+image_file_sphash (const char *file)
 {
-  int width, height, rowstride, n_channels;
-  guchar *pixels, *p;
-  int sum, avg, x, y, off;
+  unsigned char grays[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
+  gdouble coeffs[FDUPVES_DCT_LEN * FDUPVES_DCT_LEN];
   hash_t hash;
-  unsigned char *grays, dct[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
-      dctc[FDUPVES_DCT_LEN * FDUPVES_DCT_LEN];
-
-  n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+  int u, v;
 
-  g_assert (gdk_pixbuf_get_colorspace (pixbuf) == GDK_COLORSPACE_RGB);
-  g_assert (gdk_pixbuf_get_bits_per_sample (pixbuf) == 8);
-
-  width = gdk_pixbuf_get_width (pixbuf);
-  height = gdk_pixbuf_get_height (pixbuf);
+  if (g_cache)
+    {
+      if (cache_get (g_cache, file, 0, FDUPVES_IMAGE_SPHASH, &hash))
+        {
+          return hash;
+        }
+    }
 
-  rowstride = gdk_pixbuf_get_rowstride (pixbuf);
-  pixels = gdk_pixbuf_get_pixels (pixbuf);
+  if (!phash_file_grays (file, grays))
+    {
+      return 0;
+    }
 
-  grays = g_new (unsigned char, width *height);
-  off = 0;
-  for (y = 0; y < width; ++y)
+  /* the signs, not a threshold shared by the frequencies, so that a
+   * mirror inverts exactly the odd ones; the DC term is always positive
+   * and keeps the hash valid */
+  phash_dct (grays, FDUPVES_DCT_LEN, coeffs);
+  hash = 1;
+  for (u = 0; u < FDUPVES_DCT_LEN; ++u)
     {
-      for (x = 0; x < height; ++x)
+      for (v = 0; v < FDUPVES_DCT_LEN; ++v)
         {
-          p = pixels + y * rowstride + x * n_channels;
-          grays[off] = (p[0] * 30 + p[1] * 59 + p[2] * 11) / 100;
-          ++off;
+          if ((u || v) && coeffs[u * FDUPVES_DCT_LEN + v] > 0)
+            {
+              hash |= (hash_t)1 << (u * FDUPVES_DCT_LEN + v);
+            }
         }
     }
 
-  buffer_dct (grays, dct, sizeof dct);
+  if (g_cache)
+    {
+      cache_set (g_cache, file, 0, FDUPVES_IMAGE_SPHASH, hash);
+    }
+
+  return hash;
+}
+
+hash_t
+hash_pixels_phash (const guchar *pixels, int rowstride, int channels)
+{
+  int sum, avg, x, off;
+  hash_t hash;
+  unsigned char grays[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
+      dctc[FDUPVES_DCT_LEN * FDUPVES_DCT_LEN];
+  gdouble coeffs[FDUPVES_DCT_LEN * FDUPVES_DCT_LEN];
+
+  phash_grays (pixels, rowstride, channels, grays);
+
+  phash_dct (grays, FDUPVES_DCT_LEN, coeffs);
 
+  /* the coefficients truncated to bytes, as the cached hashes were */
   sum = 0;
-  off = 0;
-  for (x = 0; x < FDUPVES_DCT_LEN; ++x)
+  for (off = 0; off < FDUPVES_DCT_LEN * FDUPVES_DCT_LEN; ++off)
     {
-      for (y = 0; y < FDUPVES_DCT_LEN; ++y)
-        {
-          sum += dct[x * FDUPVES_PHASH_LEN + y];
-          dctc[off] = dct[x * FDUPVES_PHASH_LEN + y];
-          ++off;
-        }
+      dctc[off] = (unsigned char)coeffs[off];
+      sum += dctc[off];
     }
   avg = sum / off;
 
@@ -208,125 +247,191 @@ pixbuf_phash (GdkPixbuf *pixbuf)
         }
     }
 
-  g_free (grays);
-
   return hash;
 }
 
-static gboolean
-buffer_dct (const unsigned char *pix, unsigned char *out_pix, gsize out_len)
+static void
+phash_grays (const guchar *pixels, int rowstride, int channels,
+             unsigned char *grays)
 {
-  const gdouble *quotient, *quotientT;
-  gdouble matrix[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
-      temp[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
-  gsize i, j;
+  const guchar *p;
+  int x, y, off;
 
-  g_assert (out_len >= FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN);
-
-  for (i = 0; i < FDUPVES_PHASH_LEN; i++)
+  off = 0;
+  for (y = 0; y < FDUPVES_PHASH_LEN; ++y)
     {
-      for (j = 0; j < FDUPVES_PHASH_LEN; j++)
+      for (x = 0; x < FDUPVES_PHASH_LEN; ++x)
         {
-          matrix[i * FDUPVES_PHASH_LEN + j]
-              = (gdouble)(pix[i * FDUPVES_PHASH_LEN + j]);
+          p = pixels + y * rowstride + x * channels;
+          grays[off] = channels < 3
+                           ? p[0]
+                           : (p[0] * 30 + p[1] * 59 + p[2] * 11) / 100;
+          ++off;
         }
     }
+}
 
-  quotient = get_coefficient ();
-  quotientT = get_coefficient_t ();
-
-  matrix_mul (quotient, matrix, temp);
-  matrix_mul (temp, quotientT, matrix);
+static gboolean
+phash_file_grays (const char *file, unsigned char *grays)
+{
+  GdkPixbuf *buf;
+  GError *err;
 
-  for (i = 0; i < FDUPVES_PHASH_LEN; i++)
+  err = NULL;
+  buf = fdupves_gdkpixbuf_load_file_for_hash (file, FDUPVES_PHASH_LEN,
+                                              FDUPVES_PHASH_LEN, &err);
+  if (err)
     {
-      for (j = 0; j < FDUPVES_PHASH_LEN; j++)
-        {
-          out_pix[i * FDUPVES_PHASH_LEN + j]
-              = (unsigned char)matrix[i * FDUPVES_PHASH_LEN + j];
-        }
+      g_warning ("Load file: %s to pixbuf failed: %s", file, err->message);
+      g_error_free (err);
+      return FALSE;
     }
 
+  phash_grays (gdk_pixbuf_get_pixels (buf), gdk_pixbuf_get_rowstride (buf),
+               gdk_pixbuf_get_n_channels (buf), grays);
+  g_object_unref (buf);
+
   return TRUE;
 }
 
-static const gdouble *
-get_coefficient_t ()
+static int
+phash_coeff_cmp (const gdouble *a, const gdouble *b)
 {
-  gsize i, j;
-  static gdouble *coeff_s;
-  const gdouble *c;
+  return (*a > *b) - (*a < *b);
+}
 
-  if (coeff_s)
+/* the len x len lowest frequencies of the FDUPVES_PHASH_LEN square DCT,
+ * Q * M * Q', into coeffs; only the rows and columns they need of both
+ * products are computed, every sum in the order of the full products, so
+ * the result is the same to the bit */
+static void
+phash_dct (const unsigned char *pix, int len, gdouble *coeffs)
+{
+  const gdouble *q, *qt;
+  gdouble m[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
+      temp[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
+  int i;
+
+  g_assert (len % 4 == 0 && len <= FDUPVES_PHASH_LEN);
+
+  for (i = 0; i < FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN; i++)
     {
-      return coeff_s;
+      m[i] = (gdouble)pix[i];
     }
 
-  coeff_s = g_new (gdouble, FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN);
-  g_assert (coeff_s);
+  q = phash_dct_table ();
+  qt = q + FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN;
 
-  c = get_coefficient ();
-
-  for (i = 0; i < FDUPVES_PHASH_LEN; i++)
+#if defined(FDUPVES_DCT_REFERENCE)
+  /* the two full products */
+  phash_mul_rows (q, FDUPVES_PHASH_LEN, m, FDUPVES_PHASH_LEN, temp);
+  phash_mul_rows (temp, FDUPVES_PHASH_LEN, qt, FDUPVES_PHASH_LEN, m);
+  for (i = 0; i < len * len; i++)
     {
-      for (j = 0; j < FDUPVES_PHASH_LEN; j++)
-        {
-          coeff_s[i * FDUPVES_PHASH_LEN + j] = c[j * FDUPVES_PHASH_LEN + i];
-        }
+      coeffs[i] = m[i / len * FDUPVES_PHASH_LEN + i % len];
     }
-
-  return coeff_s;
+#elif defined(__SSE2__)
+  phash_mul_rows_sse2 (q, len, m, FDUPVES_PHASH_LEN, temp);
+  phash_mul_rows_sse2 (temp, len, qt, len, coeffs);
+#else
+  phash_mul_rows (q, len, m, FDUPVES_PHASH_LEN, temp);
+  phash_mul_rows (temp, len, qt, len, coeffs);
+#endif
 }
 
+/* the DCT matrix Q, then its transpose; built once, whatever thread asks
+ * first */
 static const gdouble *
-get_coefficient ()
+phash_dct_table ()
 {
+  static gdouble *table = NULL;
+  gdouble *q, *qt, s;
   gsize i, j;
-  static gdouble *coeff_s = NULL;
-  gdouble s;
 
-  if (coeff_s)
+  if (g_once_init_enter (&table))
     {
-      return coeff_s;
-    }
+      q = g_new (gdouble, 2 * FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN);
+      qt = q + FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN;
 
-  coeff_s = g_new (gdouble, FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN);
-  g_assert (coeff_s);
+      s = 1.0 / sqrt (FDUPVES_PHASH_LEN);
+      for (i = 0; i < FDUPVES_PHASH_LEN; i++)
+        {
+          q[i] = s;
+        }
+      for (i = 1; i < FDUPVES_PHASH_LEN; i++)
+        {
+          for (j = 0; j < FDUPVES_PHASH_LEN; j++)
+            {
+              q[i * FDUPVES_PHASH_LEN + j]
+                  = sqrt (2.0 / FDUPVES_PHASH_LEN)
+                    * cos (i * M_PI * (j + 0.5) / (gdouble)FDUPVES_PHASH_LEN);
+            }
+        }
 
-  s = 1.0 / sqrt (FDUPVES_PHASH_LEN);
-  for (i = 0; i < FDUPVES_PHASH_LEN; i++)
-    {
-      coeff_s[i] = s;
-    }
-  for (i = 1; i < FDUPVES_PHASH_LEN; i++)
-    {
-      for (j = 0; j < FDUPVES_PHASH_LEN; j++)
+      for (i = 0; i < FDUPVES_PHASH_LEN; i++)
         {
-          coeff_s[i * FDUPVES_PHASH_LEN + j]
-              = sqrt (2.0 / FDUPVES_PHASH_LEN)
-                * cos (i * M_PI * (j + 0.5) / (gdouble)FDUPVES_PHASH_LEN);
+          for (j = 0; j < FDUPVES_PHASH_LEN; j++)
+            {
+              qt[i * FDUPVES_PHASH_LEN + j] = q[j * FDUPVES_PHASH_LEN + i];
+            }
         }
+
+      g_once_init_leave (&table, q);
     }
 
-  return coeff_s;
+  return table;
 }
 
-static void
-matrix_mul (const gdouble *A, const gdouble *B, gdouble *matrix)
+/* out[i][j] = sum of a[i][k] * b[k][j], for the first rows of a and cols
+ * of b; a and b are FDUPVES_PHASH_LEN wide, out is cols wide */
+static inline void
+phash_mul_rows (const gdouble *a, int rows, const gdouble *b, int cols,
+                gdouble *out)
 {
   gdouble t;
-  gsize i, j, k;
+  int i, j, k;
 
-  for (i = 0; i < FDUPVES_PHASH_LEN; i++)
+  for (i = 0; i < rows; i++)
     {
-      for (j = 0; j < FDUPVES_PHASH_LEN; j++)
+      for (j = 0; j < cols; j++)
         {
           t = 0.0;
           for (k = 0; k < FDUPVES_PHASH_LEN; k++)
             {
-              t += A[i * FDUPVES_PHASH_LEN + k] * B[k * FDUPVES_PHASH_LEN + j];
+              t += a[i * FDUPVES_PHASH_LEN + k] * b[k * FDUPVES_PHASH_LEN + j];
+            }
+          out[i * cols + j] = t;
+        }
+    }
+}
+
+#ifdef __SSE2__
+/* the same, 4 columns at once: every lane adds its products in the same
+ * order as the scalar loop, and rounds the same */
+static inline void
+phash_mul_rows_sse2 (const gdouble *a, int rows, const gdouble *b, int cols,
+                     gdouble *out)
+{
+  __m128d t0, t1, ak;
+  const gdouble *bk;
+  int i, j, k;
+
+  for (i = 0; i < rows; i++)
+    {
+      for (j = 0; j < cols; j += 4)
+        {
+          t0 = _mm_setzero_pd ();
+          t1 = _mm_setzero_pd ();
+          for (k = 0; k < FDUPVES_PHASH_LEN; k++)
+            {
+              ak = _mm_set1_pd (a[i * FDUPVES_PHASH_LEN + k]);
+              bk = b + k * FDUPVES_PHASH_LEN + j;
+              t0 = _mm_add_pd (t0, _mm_mul_pd (ak, _mm_loadu_pd (bk)));
+              t1 = _mm_add_pd (t1, _mm_mul_pd (ak, _mm_loadu_pd (bk + 2)));
             }
-          matrix[i * FDUPVES_PHASH_LEN + j] = t;
+          _mm_storeu_pd (out + i * cols + j, t0);
+          _mm_storeu_pd (out + i * cols + j + 2, t1);
         }
     }
 }
+#endif
@@ -0,0 +1,215 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE ring.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "ring.h"
+
+#include <glib.h>
+
+/* spins before sleeping, then the sleep doubles up to the max */
+#ifndef FDUPVES_RING_SPINS
+#define FDUPVES_RING_SPINS 64
+#endif
+
+#ifndef FDUPVES_RING_SLEEP_MAX
+#define FDUPVES_RING_SLEEP_MAX 2000
+#endif
+
+struct ring_cell
+{
+  volatile gint seq;
+  gpointer data;
+};
+
+struct ring_s
+{
+  struct ring_cell *cells;
+  guint mask;
+
+  /* keep the two counters on their own cache lines */
+  volatile gint head;
+  gchar pad1[64 - sizeof (gint)];
+  volatile gint tail;
+  gchar pad2[64 - sizeof (gint)];
+
+  volatile gint closed;
+};
+
+static void ring_wait (guint *);
+
+ring_t *
+ring_new (guint capacity)
+{
+  ring_t *ring;
+  guint size, i;
+
+  for (size = 2; size < capacity; size <<= 1)
+    ;
+
+  ring = g_new0 (ring_t, 1);
+  g_return_val_if_fail (ring, NULL);
+
+  ring->cells = g_new (struct ring_cell, size);
+  ring->mask = size - 1;
+  for (i = 0; i < size; ++i)
+    {
+      ring->cells[i].seq = (gint)i;
+      ring->cells[i].data = NULL;
+    }
+
+  return ring;
+}
+
+void
+ring_free (ring_t *ring)
+{
+  g_free (ring->cells);
+  g_free (ring);
+}
+
+gboolean
+ring_try_push (ring_t *ring, gpointer data)
+{
+  struct ring_cell *cell;
+  guint pos, seq;
+  gint dif;
+
+  pos = (guint)g_atomic_int_get (&ring->tail);
+  for (;;)
+    {
+      cell = ring->cells + (pos & ring->mask);
+      seq = (guint)g_atomic_int_get (&cell->seq);
+      dif = (gint)(seq - pos);
+      if (dif == 0)
+        {
+          if (g_atomic_int_compare_and_exchange (&ring->tail, (gint)pos,
+                                                 (gint)(pos + 1)))
+            {
+              break;
+            }
+        }
+      else if (dif < 0)
+        {
+          /* full */
+          return FALSE;
+        }
+
+      pos = (guint)g_atomic_int_get (&ring->tail);
+    }
+
+  cell->data = data;
+  g_atomic_int_set (&cell->seq, (gint)(pos + 1));
+
+  return TRUE;
+}
+
+gpointer
+ring_try_pop (ring_t *ring)
+{
+  struct ring_cell *cell;
+  gpointer data;
+  guint pos, seq;
+  gint dif;
+
+  pos = (guint)g_atomic_int_get (&ring->head);
+  for (;;)
+    {
+      cell = ring->cells + (pos & ring->mask);
+      seq = (guint)g_atomic_int_get (&cell->seq);
+      dif = (gint)(seq - (pos + 1));
+      if (dif == 0)
+        {
+          if (g_atomic_int_compare_and_exchange (&ring->head, (gint)pos,
+                                                 (gint)(pos + 1)))
+            {
+              break;
+            }
+        }
+      else if (dif < 0)
+        {
+          /* empty */
+          return NULL;
+        }
+
+      pos = (guint)g_atomic_int_get (&ring->head);
+    }
+
+  data = cell->data;
+  g_atomic_int_set (&cell->seq, (gint)(pos + ring->mask + 1));
+
+  return data;
+}
+
+void
+ring_push (ring_t *ring, gpointer data)
+{
+  guint tries;
+
+  for (tries = 0; !ring_try_push (ring, data); ++tries)
+    {
+      ring_wait (&tries);
+    }
+}
+
+gpointer
+ring_pop (ring_t *ring)
+{
+  gpointer data;
+  guint tries;
+
+  for (tries = 0; (data = ring_try_pop (ring)) == NULL; ++tries)
+    {
+      if (g_atomic_int_get (&ring->closed))
+        {
+          /* a push may have landed before the close */
+          return ring_try_pop (ring);
+        }
+
+      ring_wait (&tries);
+    }
+
+  return data;
+}
+
+void
+ring_close (ring_t *ring)
+{
+  g_atomic_int_set (&ring->closed, 1);
+}
+
+static void
+ring_wait (guint *tries)
+{
+  guint shift;
+
+  if (*tries < FDUPVES_RING_SPINS)
+    {
+      g_thread_yield ();
+      return;
+    }
+
+  shift = MIN (*tries - FDUPVES_RING_SPINS, 10);
+  g_usleep (MIN ((gulong)10 << shift, FDUPVES_RING_SLEEP_MAX));
+}
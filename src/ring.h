@@ -0,0 +1,55 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE ring.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_RING_H_
+#define _FDUPVES_RING_H_
+
+#include <glib.h>
+
+/* bounded multi producer, multi consumer queue of non NULL pointers,
+ * every slot carries a sequence number so push and pop only race on one
+ * atomic counter each.
+ */
+typedef struct ring_s ring_t;
+
+ring_t *ring_new (guint);
+
+void ring_free (ring_t *);
+
+gboolean ring_try_push (ring_t *, gpointer);
+
+gpointer ring_try_pop (ring_t *);
+
+/* waits while the ring is full */
+void ring_push (ring_t *, gpointer);
+
+/* waits while the ring is empty, NULL once it is closed and drained */
+gpointer ring_pop (ring_t *);
+
+/* no more push, wakes the waiting consumers */
+void ring_close (ring_t *);
+
+#endif
@@ -0,0 +1,1136 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE scan.c
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#include "scan.h"
+#include "audio.h"
+#include "cache.h"
+#include "compare.h"
+#include "ebook.h"
+#include "exact.h"
+#include "hash.h"
+#include "ini.h"
+#include "match.h"
+#include "ring.h"
+#include "util.h"
+#include "video.h"
+
+#include <string.h>
+
+/* files and hashes in flight between the stages */
+#ifndef FD_SCAN_QUEUE
+#define FD_SCAN_QUEUE 1024
+#endif
+
+/* the number of files is not known up front */
+#ifndef FD_SCAN_INDEX_HINT
+#define FD_SCAN_INDEX_HINT (1 << 16)
+#endif
+
+/* microseconds between two progress reports */
+#ifndef FD_SCAN_TICK
+#define FD_SCAN_TICK (100 * 1000)
+#endif
+
+/* FD_IMAGE .. FD_EBOOK, one matcher each */
+#define FD_SCAN_TYPES (FD_EBOOK - FD_IMAGE + 1)
+
+struct scan_job
+{
+  gchar *path;
+  int type;
+
+  /* unchanged since the last scan, and its length then */
+  gboolean old;
+  float length;
+};
+
+/* a file as the last scan and this one saw it */
+struct scan_file
+{
+  gint64 size;
+  gint64 mtime;
+  gboolean old;
+
+  /* videos and audios, 0 until known */
+  float length;
+};
+
+struct scan_pair
+{
+  gchar *a;
+  gchar *b;
+  same_type type;
+  float offset;
+};
+
+struct scan_result
+{
+  gchar *path;
+  int type;
+  gboolean old;
+  match_file file;
+
+  /* the first file with its content, NULL when it can not be read */
+  gconstpointer root;
+};
+
+/* the files of one kind matched so far, which of them are old and the
+ * root of their content */
+struct scan_domain
+{
+  match_domain_t *match;
+  GArray *olds;
+  GPtrArray *roots;
+};
+
+/* one media type: its hashes and the thread matching them */
+struct scan_matcher
+{
+  scan_t *scan;
+  ring_t *results;
+  GThread *thread;
+};
+
+struct scan_s
+{
+  find_step_cb cb;
+  gpointer arg;
+  GCancellable *cancel;
+  find_step step[1];
+
+  GPtrArray *roots;
+
+  /* incremental: the files and pairs of the last scan, the files walked
+   * and the pairs found by this one */
+  gboolean incremental;
+  GHashTable *last;
+  GPtrArray *last_pairs;
+  GHashTable *walked;
+  GHashTable *pairs;
+
+  ring_t *jobs;
+  struct scan_matcher matchers[FD_SCAN_TYPES];
+
+  /* byte identical files of every media type, decoded once */
+  exact_t *exacts[FD_SCAN_TYPES];
+
+  /* files queued, files hashed, hash and match threads still running */
+  volatile gint queued;
+  volatile gint hashed;
+  volatile gint running;
+  gint matching;
+
+  /* the matchers report one at a time, the last one signals done */
+  GMutex lock;
+  GCond done;
+
+  struct scan_domain domains[FD_SCAN_TYPES];
+
+  int count;
+};
+
+static gboolean scan_quit (scan_t *);
+
+static gpointer scan_walk_thread (scan_t *);
+
+static void scan_queue_file (const gchar *, scan_t *);
+
+static gpointer scan_hash_thread (scan_t *);
+
+static void scan_hash (scan_t *, struct scan_job *);
+
+static void scan_decode (struct scan_job *, GPtrArray *);
+
+static void scan_exact (scan_t *, struct scan_job *, exact_file *);
+
+static void scan_copy (struct scan_job *, exact_file *, GPtrArray *);
+
+static void scan_keep_length (scan_t *, const gchar *, GPtrArray *);
+
+static GPtrArray *scan_templates (GPtrArray *);
+
+static ring_t *scan_results (scan_t *, int);
+
+static gpointer scan_match_thread (struct scan_matcher *);
+
+static void scan_progress (scan_t *);
+
+static struct scan_result *scan_result_new (struct scan_job *);
+
+static void scan_result_free (struct scan_result *);
+
+static void scan_match (scan_t *, struct scan_result *);
+
+static void scan_report (scan_t *, struct scan_domain *,
+                         const compare_match *);
+
+static gboolean scan_known (guint, guint, struct scan_domain *);
+
+static void scan_emit (scan_t *, const gchar *, const gchar *, same_type,
+                       float, int, gboolean);
+
+static void scan_keep_pair (scan_t *, const gchar *, const gchar *,
+                            same_type, float);
+
+static gchar *scan_pair_key (const gchar *, const gchar *);
+
+static struct scan_pair *scan_pair_new (const gchar *, const gchar *,
+                                        same_type, float);
+
+static void scan_pair_free (struct scan_pair *);
+
+static gchar *scan_settings ();
+
+static void scan_load (scan_t *);
+
+static void scan_last_file (const gchar *, gint64, gint64, float, scan_t *);
+
+static void scan_last_pair (const gchar *, const gchar *, int, float,
+                            scan_t *);
+
+static void scan_finish (scan_t *);
+
+static void scan_save (scan_t *, GPtrArray *);
+
+static void scan_domain_init (struct scan_domain *, int);
+
+static void scan_domain_clear (struct scan_domain *);
+
+scan_t *
+scan_new (find_step_cb cb, gpointer arg)
+{
+  scan_t *scan;
+  int i;
+
+  scan = g_new0 (scan_t, 1);
+  g_return_val_if_fail (scan, NULL);
+
+  scan->cb = cb;
+  scan->arg = arg;
+  g_mutex_init (&scan->lock);
+  g_cond_init (&scan->done);
+  scan->roots = g_ptr_array_new_with_free_func (g_free);
+
+  scan->incremental = g_ini->incremental && g_cache;
+  scan->last = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  scan->last_pairs
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)scan_pair_free);
+  scan->walked
+      = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  scan->pairs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify)scan_pair_free);
+
+  for (i = 0; i < FD_SCAN_TYPES; ++i)
+    {
+      scan_domain_init (scan->domains + i, FD_IMAGE + i);
+    }
+
+  return scan;
+}
+
+void
+scan_free (scan_t *scan)
+{
+  int i;
+
+  for (i = 0; i < FD_SCAN_TYPES; ++i)
+    {
+      scan_domain_clear (scan->domains + i);
+    }
+
+  g_ptr_array_free (scan->roots, TRUE);
+  g_hash_table_destroy (scan->last);
+  g_ptr_array_free (scan->last_pairs, TRUE);
+  g_hash_table_destroy (scan->walked);
+  g_hash_table_destroy (scan->pairs);
+  g_mutex_clear (&scan->lock);
+  g_cond_clear (&scan->done);
+  g_free (scan);
+}
+
+void
+scan_add (scan_t *scan, const gchar *path)
+{
+  g_ptr_array_add (scan->roots, g_strdup (path));
+}
+
+void
+scan_set_cancellable (scan_t *scan, GCancellable *cancel)
+{
+  scan->cancel = cancel;
+}
+
+int
+scan_run (scan_t *scan)
+{
+  GThread *walker, **hashers;
+  struct scan_matcher *matcher;
+  gint64 end;
+  gint i, n;
+
+  n = MAX (g_ini->threads_count, 1);
+
+  scan->jobs = ring_new (FD_SCAN_QUEUE);
+  for (i = 0; i < FD_SCAN_TYPES; ++i)
+    {
+      scan->matchers[i].scan = scan;
+      scan->matchers[i].results = ring_new (FD_SCAN_QUEUE);
+      scan->exacts[i] = exact_new ((GDestroyNotify)g_ptr_array_unref);
+    }
+  scan->queued = 0;
+  scan->hashed = 0;
+  scan->running = n;
+  scan->matching = FD_SCAN_TYPES;
+  scan->count = 0;
+
+  scan->step->found = FALSE;
+  scan->step->total = 0;
+  scan->step->now = 0;
+  scan->step->doing = _ ("Scan and compare files");
+  scan->step->offset = 0;
+  scan->step->removed = FALSE;
+  scan->step->distance = -1;
+
+  if (scan->incremental)
+    {
+      scan_load (scan);
+    }
+
+  walker = g_thread_new ("walk", (GThreadFunc)scan_walk_thread, scan);
+  hashers = g_new (GThread *, n);
+  for (i = 0; i < n; ++i)
+    {
+      hashers[i] = g_thread_new ("hash", (GThreadFunc)scan_hash_thread, scan);
+    }
+
+  /* every media type matches on its own thread, an audio match does not
+   * hold back the images, and the indexes need no lock */
+  for (i = 0; i < FD_SCAN_TYPES; ++i)
+    {
+      matcher = scan->matchers + i;
+      matcher->thread = g_thread_new ("match", (GThreadFunc)scan_match_thread,
+                                      matcher);
+    }
+
+  g_mutex_lock (&scan->lock);
+  while (scan->matching > 0)
+    {
+      scan_progress (scan);
+      end = g_get_monotonic_time () + FD_SCAN_TICK;
+      g_cond_wait_until (&scan->done, &scan->lock, end);
+    }
+  g_mutex_unlock (&scan->lock);
+
+  g_thread_join (walker);
+  for (i = 0; i < n; ++i)
+    {
+      g_thread_join (hashers[i]);
+    }
+  g_free (hashers);
+
+  ring_free (scan->jobs);
+  scan->jobs = NULL;
+  for (i = 0; i < FD_SCAN_TYPES; ++i)
+    {
+      g_thread_join (scan->matchers[i].thread);
+      ring_free (scan->matchers[i].results);
+      exact_free (scan->exacts[i]);
+      scan->matchers[i].thread = NULL;
+      scan->matchers[i].results = NULL;
+      scan->exacts[i] = NULL;
+    }
+
+  /* a stopped scan did not see every file, keep the last one */
+  if (scan->incremental && !scan_quit (scan))
+    {
+      scan_finish (scan);
+    }
+
+  return scan->count;
+}
+
+static gboolean
+scan_quit (scan_t *scan)
+{
+  return g_cancellable_is_cancelled (scan->cancel);
+}
+
+static gpointer
+scan_walk_thread (scan_t *scan)
+{
+  guint i;
+
+  for (i = 0; i < scan->roots->len && !scan_quit (scan); ++i)
+    {
+      fd_walk (g_ptr_array_index (scan->roots, i), scan->cancel,
+               (fd_walk_func)scan_queue_file, scan);
+    }
+
+  ring_close (scan->jobs);
+
+  return NULL;
+}
+
+static void
+scan_queue_file (const gchar *path, scan_t *scan)
+{
+  struct scan_job *job;
+  struct scan_file *file, *last;
+  int types[4], i, n;
+  gboolean old;
+  float length;
+
+  n = 0;
+  if (g_ini->proc_image && is_image (path))
+    {
+      types[n++] = FD_IMAGE;
+    }
+
+  /* videos meet the audios when comparing their sound track */
+  if (g_ini->compare_area == FD_COMPARE_AUDIO_IN_VIDEO && is_video (path)
+      && (g_ini->proc_video || g_ini->proc_audio))
+    {
+      types[n++] = FD_AUDIO;
+    }
+  else
+    {
+      if (g_ini->proc_video && is_video (path))
+        {
+          types[n++] = FD_VIDEO;
+        }
+      if (g_ini->proc_audio && is_audio (path))
+        {
+          types[n++] = FD_AUDIO;
+        }
+    }
+
+  if (g_ini->proc_ebook && is_ebook (path))
+    {
+      types[n++] = FD_EBOOK;
+    }
+
+  if (n == 0)
+    {
+      g_debug ("%s is not image/video/audio/e-book, skipped", path);
+      return;
+    }
+
+  old = FALSE;
+  length = 0;
+  if (scan->incremental)
+    {
+      file = g_new0 (struct scan_file, 1);
+      if (cache_stat (path, &file->size, &file->mtime))
+        {
+          last = g_hash_table_lookup (scan->last, path);
+          old = last && last->size == file->size
+                && last->mtime == file->mtime;
+        }
+      file->old = old;
+      if (old)
+        {
+          length = file->length = last->length;
+        }
+
+      /* the hash threads fill in the lengths */
+      g_mutex_lock (&scan->lock);
+      g_hash_table_replace (scan->walked, g_strdup (path), file);
+      g_mutex_unlock (&scan->lock);
+    }
+
+  for (i = 0; i < n; ++i)
+    {
+      job = g_new (struct scan_job, 1);
+      job->path = g_strdup (path);
+      job->type = types[i];
+      job->old = old;
+      job->length = length;
+
+      g_atomic_int_inc (&scan->queued);
+      ring_push (scan->jobs, job);
+    }
+}
+
+static gpointer
+scan_hash_thread (scan_t *scan)
+{
+  struct scan_job *job;
+  int i;
+
+  /* the FFmpeg reads under scan_hash stop with the scan */
+  fd_push_cancel (scan->cancel);
+  while ((job = ring_pop (scan->jobs)) != NULL)
+    {
+      if (!scan_quit (scan))
+        {
+          scan_hash (scan, job);
+        }
+      g_free (job->path);
+      g_free (job);
+
+      g_atomic_int_inc (&scan->hashed);
+    }
+  fd_pop_cancel (scan->cancel);
+
+  if (g_atomic_int_dec_and_test (&scan->running))
+    {
+      for (i = 0; i < FD_SCAN_TYPES; ++i)
+        {
+          ring_close (scan->matchers[i].results);
+        }
+    }
+
+  return NULL;
+}
+
+static void
+scan_hash (scan_t *scan, struct scan_job *job)
+{
+  exact_t *exact;
+  exact_file *file, *same, *root;
+  struct scan_result *result;
+  GPtrArray *results;
+  guint i;
+
+  results = g_ptr_array_new ();
+  exact = scan->exacts[job->type - FD_IMAGE];
+
+  /* a copy takes the hashes of the first file with its content */
+  file = exact_add (exact, job->path, &same);
+  root = file;
+  if (same)
+    {
+      scan_exact (scan, job, same);
+      root = exact_wait (exact, same);
+      scan_copy (job, root, results);
+      exact_publish (exact, file, NULL);
+    }
+  else
+    {
+      scan_decode (job, results);
+      if (file)
+        {
+          exact_publish (exact, file, scan_templates (results));
+        }
+    }
+
+  for (i = 0; i < results->len; ++i)
+    {
+      result = g_ptr_array_index (results, i);
+      result->root = root;
+    }
+
+  if (scan->incremental && !job->old && results->len > 0)
+    {
+      scan_keep_length (scan, job->path, results);
+    }
+
+  for (i = 0; i < results->len; ++i)
+    {
+      ring_push (scan_results (scan, job->type),
+                 g_ptr_array_index (results, i));
+    }
+  g_ptr_array_free (results, TRUE);
+}
+
+static void
+scan_decode (struct scan_job *job, GPtrArray *results)
+{
+  struct scan_result *result;
+  ebook_hash_t ehash[1];
+  float length, offsets[FD_MATCH_GROUPS * 2];
+  hash_t hashs[FD_MATCH_GROUPS * 2];
+  int g, i, n, groups[FD_MATCH_GROUPS];
+
+  switch (job->type)
+    {
+    case FD_IMAGE:
+      result = scan_result_new (job);
+      result->file.heads[0] = g_ini->image_symmetric
+                                  ? image_file_sphash (job->path)
+                                  : image_file_hash (job->path);
+      g_ptr_array_add (results, result);
+      break;
+
+    case FD_EBOOK:
+      memset (ehash, 0, sizeof ehash);
+      ebook_file_hash (job->path, ehash);
+      result = scan_result_new (job);
+      result->file.heads[0] = ehash->cover_hash;
+      g_ptr_array_add (results, result);
+      break;
+
+    case FD_VIDEO:
+      length = job->length > 0 ? job->length : video_get_length (job->path);
+      if (length <= 0)
+        {
+          g_warning ("Can't get duration of %s", job->path);
+          break;
+        }
+
+      if (g_ini->video_frames > 0)
+        {
+          result = scan_result_new (job);
+          result->file.length = length;
+          result->file.frames = g_new0 (hash_t, g_ini->video_frames);
+          video_frames_hash (job->path, length, g_ini->video_frames,
+                             result->file.frames);
+          g_ptr_array_add (results, result);
+          break;
+        }
+
+      /* one record for all the timer groups the length falls in, their
+       * screenshots from one decoder session */
+      for (g = 0, n = 0; g < FD_MATCH_GROUPS && g_ini->video_timers[g][0];
+           ++g)
+        {
+          if (length >= g_ini->video_timers[g][0]
+              && length <= g_ini->video_timers[g][1])
+            {
+              groups[n / 2] = g;
+              offsets[n++] = g_ini->video_timers[g][2];
+              offsets[n++] = length - g_ini->video_timers[g][2];
+            }
+        }
+      if (n == 0)
+        {
+          break;
+        }
+
+      video_times_hash (job->path, offsets, n, hashs);
+      result = scan_result_new (job);
+      result->file.length = length;
+      for (i = 0; i < n / 2; ++i)
+        {
+          result->file.heads[groups[i]] = hashs[2 * i];
+          result->file.tails[groups[i]] = hashs[2 * i + 1];
+        }
+      g_ptr_array_add (results, result);
+      break;
+
+    case FD_AUDIO:
+      length = job->length > 0 ? job->length : audio_get_length (job->path);
+      if (length <= 0.1f)
+        {
+          g_warning ("Can't get duration of %s", job->path);
+          break;
+        }
+
+      result = scan_result_new (job);
+      result->file.length = length;
+      result->file.peaks = audio_hashes (job->path);
+      g_ptr_array_add (results, result);
+      break;
+
+    default:
+      break;
+    }
+}
+
+/* reported whatever the file decodes to, or when it does not */
+static void
+scan_exact (scan_t *scan, struct scan_job *job, exact_file *same)
+{
+  g_mutex_lock (&scan->lock);
+  if (scan->incremental)
+    {
+      scan_keep_pair (scan, exact_path (same), job->path,
+                      compare_exact_type (job->type), 0);
+    }
+  scan_emit (scan, exact_path (same), job->path,
+             compare_exact_type (job->type), 0, 0, FALSE);
+  g_mutex_unlock (&scan->lock);
+}
+
+/* the peaks are too big to keep for every file, a copy reads them back
+ * from the cache of its representative */
+static void
+scan_copy (struct scan_job *job, exact_file *same, GPtrArray *results)
+{
+  GPtrArray *templates;
+  struct scan_result *result, *template;
+  guint i;
+
+  templates = exact_payload (same);
+  for (i = 0; templates && i < templates->len; ++i)
+    {
+      template = g_ptr_array_index (templates, i);
+      result = scan_result_new (job);
+      result->file = template->file;
+      if (template->file.frames)
+        {
+          result->file.frames = g_new (hash_t, g_ini->video_frames);
+          memcpy (result->file.frames, template->file.frames,
+                  g_ini->video_frames * sizeof (hash_t));
+        }
+      if (job->type == FD_AUDIO)
+        {
+          result->file.peaks = audio_hashes (exact_path (same));
+        }
+      g_ptr_array_add (results, result);
+    }
+}
+
+/* saved with the file, the next scan seeks its hashes without probing */
+static void
+scan_keep_length (scan_t *scan, const gchar *path, GPtrArray *results)
+{
+  struct scan_result *result;
+  struct scan_file *file;
+
+  result = g_ptr_array_index (results, 0);
+  if (result->file.length <= 0)
+    {
+      return;
+    }
+
+  g_mutex_lock (&scan->lock);
+  file = g_hash_table_lookup (scan->walked, path);
+  if (file)
+    {
+      file->length = result->file.length;
+    }
+  g_mutex_unlock (&scan->lock);
+}
+
+static GPtrArray *
+scan_templates (GPtrArray *results)
+{
+  GPtrArray *templates;
+  struct scan_result *result, *template;
+  guint i;
+
+  templates
+      = g_ptr_array_new_with_free_func ((GDestroyNotify)scan_result_free);
+  for (i = 0; i < results->len; ++i)
+    {
+      result = g_ptr_array_index (results, i);
+      template = g_new0 (struct scan_result, 1);
+      template->type = result->type;
+      template->file = result->file;
+      template->file.peaks = NULL;
+      if (result->file.frames)
+        {
+          template->file.frames = g_new (hash_t, g_ini->video_frames);
+          memcpy (template->file.frames, result->file.frames,
+                  g_ini->video_frames * sizeof (hash_t));
+        }
+      g_ptr_array_add (templates, template);
+    }
+
+  return templates;
+}
+
+static ring_t *
+scan_results (scan_t *scan, int type)
+{
+  return scan->matchers[type - FD_IMAGE].results;
+}
+
+static gpointer
+scan_match_thread (struct scan_matcher *matcher)
+{
+  scan_t *scan;
+  struct scan_result *result;
+
+  scan = matcher->scan;
+  while ((result = ring_pop (matcher->results)) != NULL)
+    {
+      if (!scan_quit (scan))
+        {
+          scan_match (scan, result);
+        }
+      scan_result_free (result);
+    }
+
+  g_mutex_lock (&scan->lock);
+  --scan->matching;
+  g_cond_signal (&scan->done);
+  g_mutex_unlock (&scan->lock);
+
+  return NULL;
+}
+
+/* with the lock held, one report for all the media types */
+static void
+scan_progress (scan_t *scan)
+{
+  scan->step->found = FALSE;
+  scan->step->total = g_atomic_int_get (&scan->queued);
+  scan->step->now = g_atomic_int_get (&scan->hashed);
+  scan->cb (scan->step, scan->arg);
+}
+
+static struct scan_result *
+scan_result_new (struct scan_job *job)
+{
+  struct scan_result *result;
+
+  result = g_new0 (struct scan_result, 1);
+  result->path = g_strdup (job->path);
+  result->type = job->type;
+  result->old = job->old;
+
+  return result;
+}
+
+static void
+scan_result_free (struct scan_result *result)
+{
+  if (result->file.peaks)
+    {
+      hash_array_free (result->file.peaks);
+    }
+  g_free (result->file.frames);
+  g_free (result->path);
+  g_free (result);
+}
+
+static void
+scan_match (scan_t *scan, struct scan_result *result)
+{
+  struct scan_domain *domain;
+  compare_match *match;
+  GArray *matches;
+  guint i, cur;
+
+  /* nothing to find an audio by */
+  if (result->type == FD_AUDIO
+      && (result->file.peaks == NULL
+          || hash_array_size (result->file.peaks) == 0))
+    {
+      return;
+    }
+
+  domain = scan->domains + (result->type - FD_IMAGE);
+  cur = match_domain_add (domain->match, result->path, &result->file);
+  g_array_append_val (domain->olds, result->old);
+  g_ptr_array_add (domain->roots, (gpointer)result->root);
+
+  matches = g_array_new (FALSE, FALSE, sizeof (compare_match));
+  match_domain_query (domain->match, cur, (match_skip_func)scan_known,
+                      domain, matches);
+  for (i = 0; i < matches->len; ++i)
+    {
+      match = &g_array_index (matches, compare_match, i);
+      if (match_domain_verify (domain->match, match))
+        {
+          scan_report (scan, domain, match);
+        }
+    }
+  g_array_free (matches, TRUE);
+}
+
+static void
+scan_report (scan_t *scan, struct scan_domain *domain,
+             const compare_match *match)
+{
+  const gchar *afile, *bfile;
+
+  afile = match_domain_path (domain->match, match->a);
+  bfile = match_domain_path (domain->match, match->b);
+
+  g_mutex_lock (&scan->lock);
+  if (scan->incremental)
+    {
+      scan_keep_pair (scan, afile, bfile, match->type, match->offset);
+    }
+  scan_emit (scan, afile, bfile, match->type, match->offset,
+             match->distance, FALSE);
+  g_mutex_unlock (&scan->lock);
+}
+
+/* both unchanged, the last scan already compared them, or copies of one
+ * content, reported by scan_exact */
+static gboolean
+scan_known (guint a, guint b, struct scan_domain *domain)
+{
+  gconstpointer root;
+
+  root = g_ptr_array_index (domain->roots, a);
+  if (root && root == g_ptr_array_index (domain->roots, b))
+    {
+      return TRUE;
+    }
+
+  return g_array_index (domain->olds, gboolean, a)
+         && g_array_index (domain->olds, gboolean, b);
+}
+
+static void
+scan_emit (scan_t *scan, const gchar *afile, const gchar *bfile,
+           same_type type, float offset, int distance, gboolean removed)
+{
+  scan->step->found = !removed;
+  scan->step->removed = removed;
+  scan->step->afile = afile;
+  scan->step->bfile = bfile;
+  scan->step->type = type;
+  scan->step->offset = offset;
+  scan->step->distance = distance;
+  scan->cb (scan->step, scan->arg);
+
+  scan->step->found = FALSE;
+  scan->step->removed = FALSE;
+  scan->step->offset = 0;
+  scan->step->distance = -1;
+  if (!removed)
+    {
+      ++scan->count;
+    }
+}
+
+static void
+scan_keep_pair (scan_t *scan, const gchar *afile, const gchar *bfile,
+                same_type type, float offset)
+{
+  g_hash_table_replace (scan->pairs, scan_pair_key (afile, bfile),
+                        scan_pair_new (afile, bfile, type, offset));
+}
+
+/* the same for both orders */
+static gchar *
+scan_pair_key (const gchar *afile, const gchar *bfile)
+{
+  if (strcmp (afile, bfile) > 0)
+    {
+      return g_strconcat (bfile, "\n", afile, NULL);
+    }
+
+  return g_strconcat (afile, "\n", bfile, NULL);
+}
+
+static struct scan_pair *
+scan_pair_new (const gchar *afile, const gchar *bfile, same_type type,
+               float offset)
+{
+  struct scan_pair *pair;
+
+  pair = g_new (struct scan_pair, 1);
+  pair->a = g_strdup (afile);
+  pair->b = g_strdup (bfile);
+  pair->type = type;
+  pair->offset = offset;
+
+  return pair;
+}
+
+static void
+scan_pair_free (struct scan_pair *pair)
+{
+  g_free (pair->a);
+  g_free (pair->b);
+  g_free (pair);
+}
+
+/* the options a stored pair depends on */
+static gchar *
+scan_settings ()
+{
+  GString *text;
+  int g;
+
+  text = g_string_new (NULL);
+  g_string_printf (text, "%d %d %d %d %d %d %d %d %d %d",
+                   g_ini->compare_area, g_ini->filter_time_rate,
+                   g_ini->same_image_distance, g_ini->same_video_distance,
+                   g_ini->same_audio_distance, g_ini->audio_align,
+                   g_ini->video_frames, g_ini->hash_algs,
+                   g_ini->same_image_verify, g_ini->image_symmetric);
+  for (g = 0; g < FD_MATCH_GROUPS && g_ini->video_timers[g][0]; ++g)
+    {
+      g_string_append_printf (text, " %d:%d:%d", g_ini->video_timers[g][0],
+                              g_ini->video_timers[g][1],
+                              g_ini->video_timers[g][2]);
+    }
+
+  return g_string_free (text, FALSE);
+}
+
+static void
+scan_load (scan_t *scan)
+{
+  gchar *settings, *last;
+
+  settings = scan_settings ();
+  last = cache_get_value (g_cache, "settings");
+
+  /* other options, other pairs: everything is new */
+  if (last && strcmp (last, settings) == 0)
+    {
+      cache_scan_files (g_cache, (cache_file_func)scan_last_file, scan);
+      cache_scan_pairs (g_cache, (cache_pair_func)scan_last_pair, scan);
+    }
+
+  g_free (settings);
+  g_free (last);
+}
+
+static void
+scan_last_file (const gchar *path, gint64 size, gint64 mtime, float length,
+                scan_t *scan)
+{
+  struct scan_file *file;
+
+  file = g_new0 (struct scan_file, 1);
+  file->size = size;
+  file->mtime = mtime;
+  file->length = length;
+  g_hash_table_replace (scan->last, g_strdup (path), file);
+}
+
+static void
+scan_last_pair (const gchar *afile, const gchar *bfile, int type,
+                float offset, scan_t *scan)
+{
+  g_ptr_array_add (scan->last_pairs,
+                   scan_pair_new (afile, bfile, (same_type)type, offset));
+}
+
+/* replay the pairs of unchanged files, report the ones that broke */
+static void
+scan_finish (scan_t *scan)
+{
+  struct scan_pair *pair;
+  struct scan_file *afile, *bfile;
+  GPtrArray *kept;
+  gchar *key;
+  gboolean found;
+  guint i;
+
+  kept = g_ptr_array_new ();
+  for (i = 0; i < scan->last_pairs->len; ++i)
+    {
+      pair = g_ptr_array_index (scan->last_pairs, i);
+      afile = g_hash_table_lookup (scan->walked, pair->a);
+      bfile = g_hash_table_lookup (scan->walked, pair->b);
+
+      key = scan_pair_key (pair->a, pair->b);
+      found = g_hash_table_contains (scan->pairs, key);
+      g_free (key);
+
+      /* copies are reported again as soon as they are found */
+      if (afile && afile->old && bfile && bfile->old && !found)
+        {
+          scan_keep_pair (scan, pair->a, pair->b, pair->type, pair->offset);
+          scan_emit (scan, pair->a, pair->b, pair->type, pair->offset, -1,
+                     FALSE);
+          continue;
+        }
+
+      if (found)
+        {
+          continue;
+        }
+
+      /* deleted, or changed and compared again without a match */
+      if ((afile && bfile)
+          || (!afile && !g_file_test (pair->a, G_FILE_TEST_EXISTS))
+          || (!bfile && !g_file_test (pair->b, G_FILE_TEST_EXISTS)))
+        {
+          scan_emit (scan, pair->a, pair->b, pair->type, pair->offset, -1,
+                     TRUE);
+          continue;
+        }
+
+      /* one is out of the roots of this scan, it is still true when the
+       * other did not change */
+      if ((afile == NULL || afile->old) && (bfile == NULL || bfile->old))
+        {
+          g_ptr_array_add (kept, pair);
+        }
+    }
+
+  scan_save (scan, kept);
+  g_ptr_array_free (kept, TRUE);
+}
+
+static void
+scan_save (scan_t *scan, GPtrArray *kept)
+{
+  GHashTableIter iter[1];
+  struct scan_file *file;
+  struct scan_pair *pair;
+  gchar *path, *settings;
+  guint i;
+
+  settings = scan_settings ();
+
+  cache_begin (g_cache);
+  cache_scan_clear (g_cache);
+  cache_set_value (g_cache, "settings", settings);
+
+  g_hash_table_iter_init (iter, scan->walked);
+  while (g_hash_table_iter_next (iter, (gpointer *)&path, (gpointer *)&file))
+    {
+      cache_scan_add_file (g_cache, path, file->size, file->mtime,
+                           file->length);
+    }
+
+  /* files out of the roots stay as they were */
+  g_hash_table_iter_init (iter, scan->last);
+  while (g_hash_table_iter_next (iter, (gpointer *)&path, (gpointer *)&file))
+    {
+      if (!g_hash_table_contains (scan->walked, path)
+          && g_file_test (path, G_FILE_TEST_EXISTS))
+        {
+          cache_scan_add_file (g_cache, path, file->size, file->mtime,
+                               file->length);
+        }
+    }
+
+  g_hash_table_iter_init (iter, scan->pairs);
+  while (g_hash_table_iter_next (iter, NULL, (gpointer *)&pair))
+    {
+      cache_scan_add_pair (g_cache, pair->a, pair->b, pair->type,
+                           pair->offset);
+    }
+  for (i = 0; i < kept->len; ++i)
+    {
+      pair = g_ptr_array_index (kept, i);
+      cache_scan_add_pair (g_cache, pair->a, pair->b, pair->type,
+                           pair->offset);
+    }
+
+  cache_commit (g_cache);
+  g_free (settings);
+}
+
+static void
+scan_domain_init (struct scan_domain *domain, int type)
+{
+  domain->match = match_domain_new (type, FD_SCAN_INDEX_HINT);
+  domain->olds = g_array_new (FALSE, FALSE, sizeof (gboolean));
+  domain->roots = g_ptr_array_new ();
+}
+
+static void
+scan_domain_clear (struct scan_domain *domain)
+{
+  match_domain_free (domain->match);
+  g_array_free (domain->olds, TRUE);
+  g_ptr_array_free (domain->roots, TRUE);
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of the fdupves package
+ * Copyright (C) <2008> Alf
+ *
+ * Contact: Alf <naihe2010@126.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+/* @CFILE scan.h
+ *
+ *  Author: Alf <naihe2010@126.com>
+ */
+
+#ifndef _FDUPVES_SCAN_H_
+#define _FDUPVES_SCAN_H_
+
+#include "find.h"
+
+#include <gio/gio.h>
+#include <glib.h>
+
+/* streaming scan:
+ * one thread walks the roots, threads_count threads hash the files of
+ * every media type as they are found, and one thread per media type
+ * matches every new hash against what came before, so pairs are
+ * reported while the walk still runs. the scan_run caller reports the
+ * progress of all of them together.
+ *
+ * with g_ini->incremental the files and pairs of a scan are kept in the
+ * cache: the next one only compares the files added or changed since,
+ * replays the pairs of the unchanged ones, and reports the pairs that
+ * broke with step->removed.
+ */
+typedef struct scan_s scan_t;
+
+scan_t *scan_new (find_step_cb, gpointer);
+
+void scan_free (scan_t *);
+
+/* a directory or a file, before scan_run */
+void scan_add (scan_t *, const gchar *);
+
+/* a cancelled scan_run returns as soon as the files in flight give up,
+ * the hashes already done stay in the cache for the next run */
+void scan_set_cancellable (scan_t *, GCancellable *);
+
+/* blocks until every file is matched, returns the pairs found */
+int scan_run (scan_t *);
+
+#endif
@@ -19,16 +19,117 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  *
  */
-/* @CFILE test_audio.c
+/* @CFILE test_mod.c
  *
  *  Author: Alf <naihe2010@126.com>
  */
 #include "../fingerprint/fingerprint.h"
 #include "audio.h"
+#include "exact.h"
+#include "find.h"
+#include "group.h"
+#include "hash.h"
+#include "hindex.h"
+#include "jsonl.h"
+#include "ring.h"
+
 #include <assert.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* a failed check is reported and counted, the others still run */
+#define TEST_CHECK(cond)                                                      \
+  do                                                                          \
+    {                                                                         \
+      if (!(cond))                                                            \
+        {                                                                     \
+          fprintf (stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                   #cond);                                                    \
+          ++test_failures;                                                    \
+        }                                                                     \
+    }                                                                         \
+  while (0)
+
+static int test_failures;
+
+/* the items every producer of test_ring pushes */
+#define TEST_RING_ITEMS 20000
+
+typedef struct
+{
+  ring_t *ring;
+  guint64 sum;
+  guint count;
+} test_ring_consumer;
+
+static int test_audio (char *[]);
+
+static hash_t test_rand_hash (GRand *);
+
+static void test_hamming (void);
+
+static void test_hindex (void);
+
+static void test_group (void);
+
+static void test_ring (void);
+
+static gpointer test_ring_produce (gpointer);
+
+static gpointer test_ring_consume (gpointer);
+
+static void test_exact (void);
+
+static void test_jsonl (void);
+
+static void test_pixels (void);
+
+static hash_t test_pixels_reference (const guchar *, int, int);
+
+static void test_hash256 (void);
+
+static void test_orient (void);
+
+static void test_dct (const guchar *, int, gdouble *);
+
+static void test_phash (void);
+
+static void test_hindex_func (guint, int, GArray *);
 
 int
 main (int argc, char *argv[])
+{
+  /* test_mod file start length out.wav: dump the fingerprint of a file */
+  if (argc > 4)
+    {
+      return test_audio (argv);
+    }
+
+  test_hamming ();
+  test_hindex ();
+  test_group ();
+  test_ring ();
+  test_exact ();
+  test_jsonl ();
+  test_pixels ();
+  test_hash256 ();
+  test_orient ();
+  test_phash ();
+
+  if (test_failures)
+    {
+      fprintf (stderr, "%d checks failed\n", test_failures);
+      return 1;
+    }
+
+  return 0;
+}
+
+static int
+test_audio (char *argv[])
 {
   hash_array_t *array;
   audio_peak_hash *hash;
@@ -57,4 +158,755 @@ main (int argc, char *argv[])
       fwrite ("]", 1, 1, fp);
       fclose (fp);
     }
-}
\ No newline at end of file
+
+  return 0;
+}
+
+static hash_t
+test_rand_hash (GRand *rand)
+{
+  return ((hash_t)g_rand_int (rand) << 32) | g_rand_int (rand);
+}
+
+/* the kernel of this cpu, vectorized or not, agrees with hash_distance
+ * on every area, on the lengths that leave a tail and on invalid hashes */
+static void
+test_hamming (void)
+{
+  const hash_kernel_t *kernel;
+  hash_t hashs[67], h, mask;
+  guint8 dists[67];
+  guint32 ids[67];
+  gsize n, i, j, cnt;
+  GRand *rand;
+  int area, threshold, k;
+
+  rand = g_rand_new_with_seed (2);
+  for (area = FD_COMPARE_ALL; area <= FD_COMPARE_RIGHT; ++area)
+    {
+      kernel = hash_kernel_get (area);
+      mask = hash_compare_mask (area);
+      for (n = 0; n <= G_N_ELEMENTS (hashs); n += 1 + n / 8)
+        {
+          h = g_rand_int_range (rand, 0, 5) ? test_rand_hash (rand) : 0;
+          for (i = 0; i < n; ++i)
+            {
+              hashs[i] = h;
+              for (k = g_rand_int_range (rand, 0, 40); k > 0; --k)
+                {
+                  hashs[i] ^= (hash_t)1 << g_rand_int_range (rand, 0, 64);
+                }
+              if (g_rand_int_range (rand, 0, 9) == 0)
+                {
+                  hashs[i] = 0;
+                }
+            }
+
+          kernel->distances (h, hashs, n, dists);
+          for (i = 0; i < n; ++i)
+            {
+              TEST_CHECK (dists[i] == hash_distance (h, hashs[i], mask));
+            }
+
+          for (threshold = 0; threshold <= FDUPVES_HASH_BITS + 1;
+               threshold += 5)
+            {
+              cnt = kernel->matches (h, hashs, n, threshold, ids);
+              for (i = 0, j = 0; i < n; ++i)
+                {
+                  if (h && hashs[i]
+                      && hash_distance (h, hashs[i], mask) < threshold)
+                    {
+                      TEST_CHECK (j < cnt && ids[j] == i);
+                      ++j;
+                    }
+                }
+              TEST_CHECK (j == cnt);
+            }
+        }
+    }
+
+  g_rand_free (rand);
+}
+
+/* every query of the multi-index finds exactly the ids a compare against
+ * every hash finds, each of them once, and a range query only the ones
+ * in its range */
+static void
+test_hindex (void)
+{
+  static const int areas[] = { FD_COMPARE_ALL, FD_COMPARE_TOP };
+  static const int distances[] = { 1, 4, 11, 30 };
+  hash_index_t *index;
+  hash_t *hashs, mask;
+  GArray *found;
+  GRand *rand;
+  guint i, id, n, want, lo, hi;
+  int a, d, b;
+
+  n = 2000;
+  rand = g_rand_new_with_seed (1);
+  hashs = g_new (hash_t, n);
+
+  /* clusters of close hashes, and some invalid ones */
+  for (i = 0; i < n; ++i)
+    {
+      if (i % 97 == 0)
+        {
+          hashs[i] = 0;
+        }
+      else if (i % 5 == 0)
+        {
+          hashs[i] = test_rand_hash (rand);
+        }
+      else
+        {
+          hashs[i] = hashs[i - i % 5];
+          if (hashs[i] == 0)
+            {
+              hashs[i] = test_rand_hash (rand);
+            }
+          for (b = g_rand_int_range (rand, 0, 8); b > 0; --b)
+            {
+              hashs[i] ^= (hash_t)1 << g_rand_int_range (rand, 0, 64);
+            }
+        }
+    }
+
+  found = g_array_new (FALSE, TRUE, sizeof (guint8));
+  for (a = 0; a < (int)G_N_ELEMENTS (areas); ++a)
+    {
+      mask = hash_compare_mask (areas[a]);
+      for (d = 0; d < (int)G_N_ELEMENTS (distances); ++d)
+        {
+          index = hash_index_new (mask, distances[d], n);
+          for (i = 0; i < n; ++i)
+            {
+              TEST_CHECK (hash_index_insert (index, hashs[i]) == i);
+            }
+          TEST_CHECK (hash_index_size (index) == n);
+
+          for (id = 0; id < n; id += 7)
+            {
+              g_array_set_size (found, 0);
+              g_array_set_size (found, n);
+              hash_index_query (index, hashs[id],
+                                (hash_index_func)test_hindex_func, found);
+              for (i = 0; i < n; ++i)
+                {
+                  want = hashs[id] && hashs[i]
+                         && hash_distance (hashs[id], hashs[i], mask)
+                                < distances[d];
+                  TEST_CHECK (g_array_index (found, guint8, i) == want);
+                }
+
+              /* the window of the earlier ids a length allows */
+              lo = g_rand_int_range (rand, 0, id + 1);
+              hi = g_rand_int_range (rand, lo, n + 1);
+              g_array_set_size (found, 0);
+              g_array_set_size (found, n);
+              hash_index_query_range (index, hashs[id], lo, hi,
+                                      (hash_index_func)test_hindex_func,
+                                      found);
+              for (i = 0; i < n; ++i)
+                {
+                  want = i >= lo && i < hi && hashs[id] && hashs[i]
+                         && hash_distance (hashs[id], hashs[i], mask)
+                                < distances[d];
+                  TEST_CHECK (g_array_index (found, guint8, i) == want);
+                }
+            }
+          hash_index_free (index);
+        }
+    }
+
+  g_array_free (found, TRUE);
+  g_free (hashs);
+  g_rand_free (rand);
+}
+
+/* counts the reports of every id */
+static void
+test_hindex_func (guint id, int dist, GArray *found)
+{
+  ++g_array_index (found, guint8, id);
+}
+
+/* the sets of same_group are the ones a relabel of every member on each
+ * union gives, collected in the documented order */
+static void
+test_group (void)
+{
+  same_group_t *group;
+  GPtrArray *sets;
+  GArray *set;
+  guint labels[60], seen[60], i, j, a, b, n, old, first, want;
+  gchar path[32];
+  GRand *rand;
+
+  n = G_N_ELEMENTS (labels);
+  rand = g_rand_new_with_seed (5);
+  group = same_group_new ();
+  for (i = 0; i < n; ++i)
+    {
+      g_snprintf (path, sizeof path, "/tmp/%u.jpg", i);
+      TEST_CHECK (same_group_intern (group, path) == i);
+      labels[i] = i;
+    }
+  TEST_CHECK (same_group_intern (group, "/tmp/7.jpg") == 7);
+  TEST_CHECK (same_group_size (group) == n);
+  TEST_CHECK (strcmp (same_group_path (group, 9), "/tmp/9.jpg") == 0);
+
+  for (i = 0; i < n / 2; ++i)
+    {
+      a = g_rand_int_range (rand, 0, n);
+      b = g_rand_int_range (rand, 0, n);
+      same_group_union (group, a, b);
+      old = labels[b];
+      for (j = 0; j < n; ++j)
+        {
+          if (labels[j] == old)
+            {
+              labels[j] = labels[a];
+            }
+        }
+    }
+
+  for (i = 0; i < n; ++i)
+    {
+      for (j = 0; j < n; ++j)
+        {
+          TEST_CHECK ((labels[i] == labels[j])
+                      == (same_group_find (group, i)
+                          == same_group_find (group, j)));
+        }
+    }
+
+  /* every id with a partner is in exactly one set, sets by first id */
+  memset (seen, 0, sizeof seen);
+  sets = same_group_collect (group);
+  first = 0;
+  for (i = 0; i < sets->len; ++i)
+    {
+      set = g_ptr_array_index (sets, i);
+      TEST_CHECK (set->len >= 2);
+      TEST_CHECK (i == 0 || g_array_index (set, guint, 0) > first);
+      first = g_array_index (set, guint, 0);
+      for (j = 0; j < set->len; ++j)
+        {
+          a = g_array_index (set, guint, j);
+          TEST_CHECK (j == 0 || a > g_array_index (set, guint, j - 1));
+          TEST_CHECK (labels[a] == labels[first]);
+          ++seen[a];
+        }
+    }
+  for (i = 0; i < n; ++i)
+    {
+      for (j = 0, want = 0; j < n; ++j)
+        {
+          want += j != i && labels[j] == labels[i];
+        }
+      TEST_CHECK (seen[i] == (want > 0));
+    }
+
+  g_ptr_array_free (sets, TRUE);
+  same_group_free (group);
+  g_rand_free (rand);
+}
+
+/* the ring keeps the order on one thread, and hands every item of many
+ * producers to exactly one of many consumers */
+static void
+test_ring (void)
+{
+  test_ring_consumer consumers[3];
+  GThread *producers[4], *threads[3];
+  ring_t *ring;
+  guint64 sum;
+  guint i, count;
+
+  ring = ring_new (8);
+  for (i = 1; i <= 8; ++i)
+    {
+      TEST_CHECK (ring_try_push (ring, GUINT_TO_POINTER (i)));
+    }
+  TEST_CHECK (!ring_try_push (ring, GUINT_TO_POINTER (9)));
+  for (i = 1; i <= 8; ++i)
+    {
+      TEST_CHECK (GPOINTER_TO_UINT (ring_try_pop (ring)) == i);
+    }
+  TEST_CHECK (ring_try_pop (ring) == NULL);
+
+  ring_push (ring, GUINT_TO_POINTER (1));
+  ring_close (ring);
+  TEST_CHECK (GPOINTER_TO_UINT (ring_pop (ring)) == 1);
+  TEST_CHECK (ring_pop (ring) == NULL);
+  ring_free (ring);
+
+  ring = ring_new (16);
+  for (i = 0; i < G_N_ELEMENTS (threads); ++i)
+    {
+      consumers[i].ring = ring;
+      consumers[i].sum = 0;
+      consumers[i].count = 0;
+      threads[i] = g_thread_new ("consume", test_ring_consume, consumers + i);
+    }
+  for (i = 0; i < G_N_ELEMENTS (producers); ++i)
+    {
+      producers[i] = g_thread_new ("produce", test_ring_produce, ring);
+    }
+  for (i = 0; i < G_N_ELEMENTS (producers); ++i)
+    {
+      g_thread_join (producers[i]);
+    }
+  ring_close (ring);
+
+  sum = 0;
+  count = 0;
+  for (i = 0; i < G_N_ELEMENTS (threads); ++i)
+    {
+      g_thread_join (threads[i]);
+      sum += consumers[i].sum;
+      count += consumers[i].count;
+    }
+  TEST_CHECK (count == G_N_ELEMENTS (producers) * TEST_RING_ITEMS);
+  TEST_CHECK (sum == (guint64)G_N_ELEMENTS (producers) * TEST_RING_ITEMS
+                         * (TEST_RING_ITEMS + 1) / 2);
+  ring_free (ring);
+}
+
+static gpointer
+test_ring_produce (gpointer ring)
+{
+  guint i;
+
+  for (i = 1; i <= TEST_RING_ITEMS; ++i)
+    {
+      ring_push (ring, GUINT_TO_POINTER (i));
+    }
+
+  return NULL;
+}
+
+static gpointer
+test_ring_consume (gpointer arg)
+{
+  test_ring_consumer *consumer = arg;
+  gpointer item;
+
+  while ((item = ring_pop (consumer->ring)) != NULL)
+    {
+      consumer->sum += GPOINTER_TO_UINT (item);
+      ++consumer->count;
+    }
+
+  return NULL;
+}
+
+/* copies are found, files that only share their size or their first and
+ * last blocks are not, and a copy gets the payload of the first file */
+static void
+test_exact (void)
+{
+  static const gchar *names[] = { "a", "copy_a", "middle", "short",
+                                  "copy_middle" };
+  exact_file *files[G_N_ELEMENTS (names)], *same, *rep;
+  gchar *dir, *paths[G_N_ELEMENTS (names)], *data;
+  gsize size, i;
+  exact_t *exact;
+
+  dir = g_dir_make_tmp ("fdupves-XXXXXX", NULL);
+  TEST_CHECK (dir != NULL);
+  if (dir == NULL)
+    {
+      return;
+    }
+
+  /* wider than the first and the last blocks the quick digest reads */
+  size = 64 * 1024 + 17;
+  data = g_malloc (size);
+  for (i = 0; i < size; ++i)
+    {
+      data[i] = (gchar)(i * 31 + i / 251);
+    }
+  for (i = 0; i < G_N_ELEMENTS (names); ++i)
+    {
+      paths[i] = g_build_filename (dir, names[i], NULL);
+      if (i == 2)
+        {
+          data[size / 2] ^= 1;
+        }
+      g_file_set_contents (paths[i], data, i == 3 ? size - 1 : size, NULL);
+    }
+  g_free (data);
+
+  exact = exact_new (g_free);
+  for (i = 0; i < G_N_ELEMENTS (names); ++i)
+    {
+      files[i] = exact_add (exact, paths[i], &same);
+      TEST_CHECK (files[i] != NULL);
+      TEST_CHECK (same == (i == 1 ? files[0] : i == 4 ? files[2] : NULL));
+    }
+
+  data = g_build_filename (dir, "missing", NULL);
+  TEST_CHECK (exact_add (exact, data, &same) == NULL && same == NULL);
+  g_free (data);
+
+  exact_publish (exact, files[0], g_strdup ("payload"));
+  exact_publish (exact, files[1], NULL);
+  rep = exact_wait (exact, files[1]);
+  TEST_CHECK (rep == files[0]);
+  TEST_CHECK (strcmp (exact_path (rep), paths[0]) == 0);
+  TEST_CHECK (strcmp (exact_payload (rep), "payload") == 0);
+  exact_free (exact);
+
+  for (i = 0; i < G_N_ELEMENTS (names); ++i)
+    {
+      g_remove (paths[i]);
+      g_free (paths[i]);
+    }
+  g_rmdir (dir);
+  g_free (dir);
+}
+
+/* quotes, backslashes and control bytes are escaped, UTF-8 is kept, and
+ * a path that is not UTF-8 is escaped byte by byte and flagged raw */
+static void
+test_jsonl (void)
+{
+  static const gchar *want
+      = "{\"a\":\"/x/q\\\"b\\\\caf\xc3\xa9.jpg\",\"b\":\"/x/t\\u0009.jpg\","
+        "\"type\":\"image\",\"distance\":3}\n"
+        "{\"a\":\"/x/t\\u0009.jpg\",\"b\":\"/x/\\u00ff.jpg\","
+        "\"b_raw\":true,\"type\":\"image\",\"distance\":null}\n"
+        "{\"group\":0,\"media\":\"image\",\"files\":["
+        "\"/x/q\\\"b\\\\caf\xc3\xa9.jpg\",\"/x/t\\u0009.jpg\","
+        "\"/x/\\u00ff.jpg\"],\"raw\":[2]}\n";
+  find_step step[1];
+  jsonl_t *jsonl;
+  gchar buf[1024];
+  gsize len;
+  FILE *fp;
+
+  fp = tmpfile ();
+  TEST_CHECK (fp != NULL);
+  if (fp == NULL)
+    {
+      return;
+    }
+
+  memset (step, 0, sizeof step);
+  jsonl = jsonl_new (fp);
+  step->found = TRUE;
+  step->type = FD_SAME_IMAGE;
+  step->afile = "/x/q\"b\\caf\xc3\xa9.jpg";
+  step->bfile = "/x/t\t.jpg";
+  step->distance = 3;
+  jsonl_step (jsonl, step);
+
+  step->afile = step->bfile;
+  step->bfile = "/x/\xff.jpg";
+  step->distance = -1;
+  jsonl_step (jsonl, step);
+
+  /* progress only, no line */
+  step->found = FALSE;
+  jsonl_step (jsonl, step);
+
+  jsonl_finish (jsonl);
+  jsonl_free (jsonl);
+
+  rewind (fp);
+  len = fread (buf, 1, sizeof buf - 1, fp);
+  buf[len] = '\0';
+  fclose (fp);
+  TEST_CHECK (strcmp (buf, want) == 0);
+}
+
+/* hash_pixels, vectorized or not, is bit-identical to the average hash
+ * of the former pixbuf_hash, on random squares and on squares whose
+ * grays all sit around their average */
+static void
+test_pixels (void)
+{
+  static const int layouts[] = { 1, 3, 4 };
+  guchar *pixels;
+  hash_t hashs[5];
+  gsize stride, size, i;
+  int l, channels, rowstride, round, base, spread;
+  GRand *rand;
+
+  rand = g_rand_new_with_seed (20);
+  for (l = 0; l < (int)G_N_ELEMENTS (layouts); ++l)
+    {
+      channels = layouts[l];
+      rowstride = FDUPVES_HASH_LEN * channels + 5;
+      stride = (gsize)rowstride * FDUPVES_HASH_LEN + 3;
+      size = stride * G_N_ELEMENTS (hashs);
+      pixels = g_malloc (size);
+      for (round = 0; round < 400; ++round)
+        {
+          base = g_rand_int_range (rand, 0, 256);
+          spread = round % 4 == 0 ? 256 : g_rand_int_range (rand, 1, 5);
+          for (i = 0; i < size; ++i)
+            {
+              pixels[i] = (guchar)CLAMP (
+                  base + g_rand_int_range (rand, -spread, spread + 1), 0,
+                  255);
+            }
+
+          hash_pixels_batch (pixels, stride, rowstride, channels,
+                             G_N_ELEMENTS (hashs), hashs);
+          for (i = 0; i < G_N_ELEMENTS (hashs); ++i)
+            {
+              TEST_CHECK (hashs[i]
+                          == test_pixels_reference (pixels + i * stride,
+                                                    rowstride, channels));
+              TEST_CHECK (hashs[i]
+                          == hash_pixels (pixels + i * stride, rowstride,
+                                          channels));
+            }
+        }
+      g_free (pixels);
+    }
+
+  g_rand_free (rand);
+}
+
+/* the former pixbuf_hash, a luma square taken as it is */
+static hash_t
+test_pixels_reference (const guchar *pixels, int rowstride, int channels)
+{
+  int grays[FDUPVES_HASH_LEN * FDUPVES_HASH_LEN], sum, avg, x, y, off;
+  const guchar *p;
+  hash_t hash;
+
+  off = 0;
+  sum = 0;
+  for (y = 0; y < FDUPVES_HASH_LEN; ++y)
+    {
+      for (x = 0; x < FDUPVES_HASH_LEN; ++x)
+        {
+          p = pixels + y * rowstride + x * channels;
+          grays[off] = channels < 3
+                           ? p[0]
+                           : (p[0] * 30 + p[1] * 59 + p[2] * 11) / 100;
+          sum += grays[off];
+          ++off;
+        }
+    }
+  avg = sum / off;
+
+  hash = 0;
+  for (x = 0; x < off; ++x)
+    {
+      if (grays[x] >= avg)
+        {
+          hash |= ((hash_t)1 << x);
+        }
+    }
+
+  return hash;
+}
+
+/* a missing 256 bits signature is -1, apart from every real distance up
+ * to the largest one */
+static void
+test_hash256 (void)
+{
+  hash256_t a[1], b[1], zero[1];
+  GRand *rand;
+  int i;
+
+  rand = g_rand_new_with_seed (23);
+  memset (zero, 0, sizeof zero);
+  for (i = 0; i < FDUPVES_HASH256_WORDS; ++i)
+    {
+      a->words[i] = test_rand_hash (rand);
+      b->words[i] = ~a->words[i];
+    }
+  TEST_CHECK (hash256_distance (a, a) == 0);
+  TEST_CHECK (hash256_distance (a, b) == FDUPVES_HASH256_BITS);
+  TEST_CHECK (hash256_distance (a, zero) == -1);
+  TEST_CHECK (hash256_distance (zero, b) == -1);
+  TEST_CHECK (hash256_distance (zero, zero) == -1);
+
+  /* a zero word is not a missing signature */
+  *b = *a;
+  b->words[1] = 0;
+  TEST_CHECK (hash256_distance (a, b) == hash_bit_count (a->words[1]));
+
+  *b = *a;
+  for (i = 0; i < 37; ++i)
+    {
+      b->words[i % FDUPVES_HASH256_WORDS] ^= (hash_t)1 << (i * 7 % 64);
+    }
+  TEST_CHECK (hash256_distance (a, b) == 37);
+
+  g_rand_free (rand);
+}
+
+/* the 256 bits signature hash_dct256_orient derives from the frequencies
+ * of an image is the one of the image really turned */
+static void
+test_orient (void)
+{
+  guchar grays[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
+      turned[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN];
+  gdouble coeffs[FDUPVES_HASH256_BITS], tcoeffs[FDUPVES_HASH256_BITS];
+  hash256_t sig[1], want[1];
+  int round, orient, x, y, sx, sy, n;
+  GRand *rand;
+
+  n = FDUPVES_PHASH_LEN;
+  rand = g_rand_new_with_seed (24);
+  for (round = 0; round < 20; ++round)
+    {
+      for (x = 0; x < n * n; ++x)
+        {
+          grays[x] = round % 2 ? g_rand_int_range (rand, 0, 256)
+                               : 128 + 100 * sin (x * 0.07 * (round + 1))
+                                     + g_rand_int_range (rand, 0, 9);
+        }
+      test_dct (grays, 16, coeffs);
+
+      /* bit 1 transposes, bit 2 mirrors the columns, bit 4 the rows */
+      for (orient = 0; orient < 8; ++orient)
+        {
+          for (y = 0; y < n; ++y)
+            {
+              for (x = 0; x < n; ++x)
+                {
+                  sx = (orient & 2) ? n - 1 - x : x;
+                  sy = (orient & 4) ? n - 1 - y : y;
+                  turned[y * n + x] = (orient & 1) ? grays[sx * n + sy]
+                                                   : grays[sy * n + sx];
+                }
+            }
+          test_dct (turned, 16, tcoeffs);
+
+          hash_dct256_orient (coeffs, orient, sig);
+          hash_dct256_orient (tcoeffs, 0, want);
+          TEST_CHECK (hash256_distance (sig, want) == 0);
+        }
+    }
+
+  g_rand_free (rand);
+}
+
+/* the len x len low frequencies of the full products Q * M * Q', the
+ * sums in the order FDUPVES_DCT_REFERENCE adds them */
+static void
+test_dct (const guchar *grays, int len, gdouble *coeffs)
+{
+  gdouble q[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN],
+      temp[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN], t;
+  int i, j, k, n;
+
+  n = FDUPVES_PHASH_LEN;
+  for (j = 0; j < n; ++j)
+    {
+      q[j] = 1.0 / sqrt (n);
+    }
+  for (i = 1; i < n; ++i)
+    {
+      for (j = 0; j < n; ++j)
+        {
+          q[i * n + j] = sqrt (2.0 / n) * cos (i * M_PI * (j + 0.5)
+                                               / (gdouble)n);
+        }
+    }
+
+  for (i = 0; i < n; ++i)
+    {
+      for (j = 0; j < n; ++j)
+        {
+          t = 0.0;
+          for (k = 0; k < n; ++k)
+            {
+              t += q[i * n + k] * (gdouble)grays[k * n + j];
+            }
+          temp[i * n + j] = t;
+        }
+    }
+
+  for (i = 0; i < len; ++i)
+    {
+      for (j = 0; j < len; ++j)
+        {
+          t = 0.0;
+          for (k = 0; k < n; ++k)
+            {
+              t += temp[i * n + k] * q[j * n + k];
+            }
+          coeffs[i * len + j] = t;
+        }
+    }
+}
+
+/* hash_pixels_phash, which only computes the products its frequencies
+ * need, gives the bits of the full products */
+static void
+test_phash (void)
+{
+  static const int layouts[] = { 1, 3, 4 };
+  guchar *pixels, grays[FDUPVES_PHASH_LEN * FDUPVES_PHASH_LEN], dctc[64];
+  gdouble coeffs[64];
+  const guchar *p;
+  int l, channels, rowstride, round, x, y, off, sum, avg;
+  hash_t want;
+  GRand *rand;
+
+  rand = g_rand_new_with_seed (25);
+  for (l = 0; l < (int)G_N_ELEMENTS (layouts); ++l)
+    {
+      channels = layouts[l];
+      rowstride = FDUPVES_PHASH_LEN * channels + 3;
+      pixels = g_malloc (rowstride * FDUPVES_PHASH_LEN);
+      for (round = 0; round < 50; ++round)
+        {
+          for (x = 0; x < rowstride * FDUPVES_PHASH_LEN; ++x)
+            {
+              pixels[x] = round % 2 ? g_rand_int_range (rand, 0, 256)
+                                    : 128 + 120 * cos (x * 0.013 * round);
+            }
+
+          off = 0;
+          for (y = 0; y < FDUPVES_PHASH_LEN; ++y)
+            {
+              for (x = 0; x < FDUPVES_PHASH_LEN; ++x)
+                {
+                  p = pixels + y * rowstride + x * channels;
+                  grays[off++]
+                      = channels < 3
+                            ? p[0]
+                            : (p[0] * 30 + p[1] * 59 + p[2] * 11) / 100;
+                }
+            }
+          test_dct (grays, 8, coeffs);
+
+          /* truncated to bytes, as the cached hashes were */
+          sum = 0;
+          for (off = 0; off < 64; ++off)
+            {
+              dctc[off] = (unsigned char)coeffs[off];
+              sum += dctc[off];
+            }
+          avg = sum / off;
+          want = 0;
+          for (x = 0; x < off; ++x)
+            {
+              if (dctc[x] >= avg)
+                {
+                  want |= (((hash_t)1) << x);
+                }
+            }
+
+          TEST_CHECK (hash_pixels_phash (pixels, rowstride, channels)
+                      == want);
+        }
+      g_free (pixels);
+    }
+
+  g_rand_free (rand);
+}
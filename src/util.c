@@ -28,6 +28,7 @@
 #include "util.h"
 #include "ini.h"
 
+#include <gio/gio.h>
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
@@ -240,4 +241,86 @@ xmlnode_attr_get (xmlNodePtr node, const char *attr)
     }
 
   return NULL;
-}
\ No newline at end of file
+}
+
+int
+fd_interrupt (void *arg)
+{
+  return g_cancellable_is_cancelled ((GCancellable *)arg);
+}
+
+void
+fd_push_cancel (GCancellable *cancel)
+{
+  if (cancel)
+    {
+      g_cancellable_push_current (cancel);
+    }
+}
+
+void
+fd_pop_cancel (GCancellable *cancel)
+{
+  if (cancel)
+    {
+      g_cancellable_pop_current (cancel);
+    }
+}
+
+void
+fd_walk (const gchar *path, GCancellable *cancel, fd_walk_func func,
+         gpointer arg)
+{
+  GQueue stack[1];
+  GDir *gdir;
+  GError *err;
+  gchar *dir, *curpath;
+  const gchar *cur;
+
+  if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
+    {
+      func (path, arg);
+      return;
+    }
+  g_queue_init (stack);
+  g_queue_push_tail (stack, g_strdup (path));
+
+  while ((dir = g_queue_pop_tail (stack)) != NULL)
+    {
+      if (g_cancellable_is_cancelled (cancel))
+        {
+          g_free (dir);
+          continue;
+        }
+
+      err = NULL;
+      gdir = g_dir_open (dir, 0, &err);
+      if (err)
+        {
+          g_warning ("Can't open dir: %s: %s", dir, err->message);
+          g_error_free (err);
+          g_free (dir);
+          continue;
+        }
+
+      while (!g_cancellable_is_cancelled (cancel)
+             && (cur = g_dir_read_name (gdir)) != NULL)
+        {
+          curpath = g_build_filename (dir, cur, NULL);
+          if (g_file_test (curpath, G_FILE_TEST_IS_DIR))
+            {
+              g_queue_push_tail (stack, curpath);
+              continue;
+            }
+
+          if (g_file_test (curpath, G_FILE_TEST_IS_REGULAR))
+            {
+              func (curpath, arg);
+            }
+          g_free (curpath);
+        }
+
+      g_dir_close (gdir);
+      g_free (dir);
+    }
+}
@@ -30,6 +30,7 @@
 
 #include <gtk/gtk.h>
 
+#include <gio/gio.h>
 #include <glib.h>
 #include <libintl.h>
 #include <libxml/tree.h>
@@ -72,6 +73,21 @@ int is_audio (const gchar *);
 
 int is_ebook (const gchar *);
 
+/* FFmpeg interrupt callback, arg is a GCancellable or NULL */
+int fd_interrupt (void *);
+
+/* make cancel the current one of this thread, NULL does nothing */
+void fd_push_cancel (GCancellable *);
+
+void fd_pop_cancel (GCancellable *);
+
+typedef void (*fd_walk_func) (const gchar *, gpointer);
+
+/* every regular file under path, or path itself when it is one; the walk
+ * stops once cancel is set, cancel may be NULL */
+void fd_walk (const gchar *path, GCancellable *cancel, fd_walk_func,
+              gpointer);
+
 xmlNodeSetPtr xmldoc_get_nodeset (xmlDocPtr doc, const char *xpath,
                                   const char *ns, const char *url);
 
@@ -34,8 +34,33 @@
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 
+#include <gio/gio.h>
 #include <glib.h>
 
+static AVFormatContext *video_format_alloc (void);
+
+static int video_open (const char *, AVFormatContext **, AVCodecContext **);
+
+static int video_read_frame (AVFormatContext *, AVCodecContext *, int,
+                             AVPacket *, AVFrame *, AVFrame *,
+                             struct SwsContext **, int, int);
+
+/* a cancelled scan interrupts the reads of its thread */
+static AVFormatContext *
+video_format_alloc (void)
+{
+  AVFormatContext *fmt_ctx;
+
+  fmt_ctx = avformat_alloc_context ();
+  if (fmt_ctx)
+    {
+      fmt_ctx->interrupt_callback.callback = fd_interrupt;
+      fmt_ctx->interrupt_callback.opaque = g_cancellable_get_current ();
+    }
+
+  return fmt_ctx;
+}
+
 video_info *
 video_get_info (const char *file)
 {
@@ -44,6 +69,7 @@ video_get_info (const char *file)
   AVStream *stream = NULL;
   int s, ret;
 
+  fmt_ctx = video_format_alloc ();
   ret = avformat_open_input (&fmt_ctx, file, NULL, NULL);
   if (ret != 0)
     {
@@ -118,16 +144,113 @@ video_get_length (const char *file)
 int
 video_time_screenshot (const char *file, int time, int width, int height,
                        char *buffer, int buf_len)
+{
+  float seconds;
+  int len;
+
+  seconds = (float)time;
+  if (video_times_screenshot (file, &seconds, 1, width, height, &buffer,
+                              buf_len, &len)
+      <= 0)
+    {
+      return -1;
+    }
+
+  return len;
+}
+
+int
+video_times_screenshot (const char *file, const float *times, int count,
+                        int width, int height, char **buffers, int buf_len,
+                        int *lens)
 {
   AVFormatContext *format_ctx = NULL;
   AVCodecContext *codec_ctx = NULL;
-  const AVCodec *codec = NULL;
   AVFrame *frame, *frame_rgb;
   AVPacket *packet;
   struct SwsContext *img_convert_ctx = NULL;
-  int s, ret, bytes;
+  int i, s, bytes, got;
   int64_t seek_target;
 
+  for (i = 0; i < count; ++i)
+    {
+      lens[i] = -1;
+    }
+
+  bytes = av_image_get_buffer_size (AV_PIX_FMT_RGB24, width, height, 1);
+  if (buf_len < bytes)
+    {
+      return -1;
+    }
+
+  s = video_open (file, &format_ctx, &codec_ctx);
+  if (s < 0)
+    {
+      return -1;
+    }
+
+  frame = av_frame_alloc ();
+  frame_rgb = av_frame_alloc ();
+  packet = av_packet_alloc ();
+  if (frame == NULL || frame_rgb == NULL || packet == NULL)
+    {
+      g_warning (_ ("Memory error: %s"), file);
+      av_packet_free (&packet);
+      av_frame_free (&frame_rgb);
+      av_frame_free (&frame);
+      avcodec_free_context (&codec_ctx);
+      avformat_close_input (&format_ctx);
+      return -1;
+    }
+
+  /* the times are ascending, every seek only goes forward */
+  got = 0;
+  for (i = 0; i < count; ++i)
+    {
+      av_image_fill_arrays (frame_rgb->data, frame_rgb->linesize,
+                            (uint8_t *)buffers[i], AV_PIX_FMT_RGB24, width,
+                            height, 1);
+
+      /* in milliseconds, the frames of a short clip are close */
+      seek_target = av_rescale (
+          (int64_t)(times[i] * 1000), format_ctx->streams[s]->time_base.den,
+          (int64_t)format_ctx->streams[s]->time_base.num * 1000);
+      avformat_seek_file (format_ctx, s, 0, seek_target, seek_target,
+                          AVSEEK_FLAG_FRAME);
+      avcodec_flush_buffers (codec_ctx);
+
+      if (video_read_frame (format_ctx, codec_ctx, s, packet, frame, frame_rgb,
+                            &img_convert_ctx, width, height)
+          == 0)
+        {
+          lens[i] = bytes;
+          ++got;
+        }
+    }
+
+  sws_freeContext (img_convert_ctx);
+  av_packet_free (&packet);
+  av_frame_free (&frame_rgb);
+  av_frame_free (&frame);
+
+  avcodec_free_context (&codec_ctx);
+
+  avformat_close_input (&format_ctx);
+
+  return got;
+}
+
+/* the decoder of the best video stream, returns its index or -1 */
+static int
+video_open (const char *file, AVFormatContext **pformat_ctx,
+            AVCodecContext **pcodec_ctx)
+{
+  AVFormatContext *format_ctx;
+  AVCodecContext *codec_ctx;
+  const AVCodec *codec;
+  int s, ret;
+
+  format_ctx = video_format_alloc ();
   if (avformat_open_input (&format_ctx, file, NULL, NULL) != 0)
     {
       g_warning (_ ("could not open: %s"), file);
@@ -168,7 +291,6 @@ video_time_screenshot (const char *file, int time, int width, int height,
     }
 
   codec_ctx->pkt_timebase = format_ctx->streams[s]->time_base;
-  // av_codec_set_pkt_timebase (codec_ctx, format_ctx->streams[s]->time_base);
   codec = avcodec_find_decoder (codec_ctx->codec_id);
   if (codec == NULL)
     {
@@ -180,51 +302,24 @@ video_time_screenshot (const char *file, int time, int width, int height,
 
   if (avcodec_open2 (codec_ctx, codec, NULL) < 0)
     {
+      avcodec_free_context (&codec_ctx);
       avformat_close_input (&format_ctx);
       return -1;
     }
 
-  frame = av_frame_alloc ();
-  if (frame == NULL)
-    {
-      avcodec_close (codec_ctx);
-      avformat_close_input (&format_ctx);
-      return -1;
-    }
-  frame_rgb = av_frame_alloc ();
-  if (frame_rgb == NULL)
-    {
-      av_frame_free (&frame);
-      avcodec_close (codec_ctx);
-      avformat_close_input (&format_ctx);
-      return -1;
-    }
-  bytes = av_image_fill_arrays (frame_rgb->data, frame_rgb->linesize,
-                                (uint8_t *)buffer, AV_PIX_FMT_RGB24, width,
-                                height, 1);
-  if (buf_len < bytes)
-    {
-      av_frame_free (&frame);
-      av_frame_free (&frame_rgb);
-      avcodec_close (codec_ctx);
-      avformat_close_input (&format_ctx);
-      return -1;
-    }
+  *pformat_ctx = format_ctx;
+  *pcodec_ctx = codec_ctx;
 
-  seek_target = av_rescale (time, format_ctx->streams[s]->time_base.den,
-                            format_ctx->streams[s]->time_base.num);
-  avformat_seek_file (format_ctx, s, 0, seek_target, seek_target,
-                      AVSEEK_FLAG_FRAME);
+  return s;
+}
 
-  packet = av_packet_alloc ();
-  if (packet == NULL)
-    {
-      av_frame_free (&frame);
-      av_frame_free (&frame_rgb);
-      avcodec_free_context (&codec_ctx);
-      avformat_close_input (&format_ctx);
-      return -1;
-    }
+/* the first frame after the last seek, scaled into frame_rgb */
+static int
+video_read_frame (AVFormatContext *format_ctx, AVCodecContext *codec_ctx,
+                  int s, AVPacket *packet, AVFrame *frame, AVFrame *frame_rgb,
+                  struct SwsContext **pimg_convert_ctx, int width, int height)
+{
+  int ret;
 
   while (av_read_frame (format_ctx, packet) >= 0)
     {
@@ -251,37 +346,27 @@ video_time_screenshot (const char *file, int time, int width, int height,
       if (ret != 0)
         {
           g_warning (_ ("Cannot receive frame from context"));
-          bytes = -1;
-          break;
+          return -1;
         }
 
-      img_convert_ctx = sws_getCachedContext (
-          img_convert_ctx, codec_ctx->width, codec_ctx->height,
+      *pimg_convert_ctx = sws_getCachedContext (
+          *pimg_convert_ctx, codec_ctx->width, codec_ctx->height,
           codec_ctx->pix_fmt, width, height, AV_PIX_FMT_RGB24,
           SWS_FAST_BILINEAR, NULL, NULL, NULL);
-      if (!img_convert_ctx)
+      if (!*pimg_convert_ctx)
         {
           g_warning (_ ("Cannot initialize sws conversion context"));
-          bytes = -1;
-          break;
+          return -1;
         }
 
-      sws_scale (img_convert_ctx, (const uint8_t *const *)frame->data,
+      sws_scale (*pimg_convert_ctx, (const uint8_t *const *)frame->data,
                  frame->linesize, 0, codec_ctx->height, frame_rgb->data,
                  frame_rgb->linesize);
-      sws_freeContext (img_convert_ctx);
-      break;
+      return 0;
     }
 
-  av_packet_free (&packet);
-  av_frame_free (&frame_rgb);
-  av_frame_free (&frame);
-
-  avcodec_free_context (&codec_ctx);
-
-  avformat_close_input (&format_ctx);
-
-  return bytes;
+  /* interrupted, or no frame after the seek */
+  return -1;
 }
 
 int
@@ -54,6 +54,13 @@ int video_get_length (const char *file);
 int video_time_screenshot (const char *file, int time, int width, int height,
                            char *buffer, int buf_len);
 
+/* one decoder session for every time, the times in seconds ascending:
+ * lens[i] is the size of the frame at times[i] in buffers[i], or -1.
+ * returns the count of frames got, or -1 */
+int video_times_screenshot (const char *file, const float *times, int count,
+                            int width, int height, char **buffers,
+                            int buf_len, int *lens);
+
 int video_time_screenshot_file (const char *file, int time, int width,
                                 int height, const char *out_file);
 